@@ -6,4 +6,5 @@ make test_float
 make rootcat
 make verify
 make identify
+make treepack
 popd
@@ -13,13 +13,13 @@ echo ""
 pushd ../bin > /dev/null
 
 # Run identify
-./rootcat ../data/identify | ./identify
+./identify ../data/identify
 
 if [ $? -eq 0 ]; then
   echo -e "Identification succeded.\n"
   # List unique intersecions for ease of checking
   echo "Rerunning to list unique variety intersections."
-  ./rootcat ../data/identify | ./identify | grep "Valid" | sort -u
+  ./identify ../data/identify | grep "Valid" | sort -u
 else
   echo "Identification failed."
   popd > /dev/null
@@ -13,7 +13,7 @@ echo ""
 pushd ../bin > /dev/null
 
 # Run verify
-./rootcat ../data/verify | ./verify
+./verify ../data/verify
 
 if [ $? -eq 0 ]; then
   echo "Identification succeded."
@@ -0,0 +1,413 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fenv.h>
+#include <getopt.h>
+#include <time.h>
+#include <map>
+#include <string>
+
+#include "elimination.h"
+#include "simd.h"
+
+// Micro-benchmarks of the arithmetic
+//
+// Each benchmark times one operation on fixed inputs, built the way the
+// verifier builds them, and prints a tab-separated line with its name, the
+// nanoseconds per operation, best of the rounds, and the operations timed.
+// Given the output of an earlier run as a baseline, each line also gets the
+// baseline time and the ratio to it, so runs can be compared with diff or
+// a spreadsheet. Build with the flags of verify, as the timing depends on
+// them.
+
+double max_area = 5.95;
+double e2_area_min = 5.65;
+double one_over_e2_min = 0.92593;
+
+// Inputs are cycled through, a power of two
+#define BENCH_INPUTS 64
+
+XComplex g_x[BENCH_INPUTS];
+ACJ g_acj[BENCH_INPUTS];
+SL2ACJ g_sl2[BENCH_INPUTS];
+LeafContext g_ctx;
+
+// Results go here, so no operation is dropped
+volatile double g_sink;
+
+XComplex random_complex(double scale)
+{
+  return XComplex(scale * (2 * drand48() - 1), scale * (2 * drand48() - 1));
+}
+
+// Jets with derivatives as small as those of a leaf, away from 0
+ACJ random_acj()
+{
+  XComplex f = random_complex(1);
+  f.re += f.re < 0 ? -1 : 1;
+  return ACJ(f, random_complex(1e-3), random_complex(1e-3),
+      random_complex(1e-3), 1e-14 * drand48());
+}
+
+// A depth 60 box in the lower half of each dimension but the lattice's
+// imaginary part, so its cusp area stays positive
+char g_boxcode[] = "100000100000100000100000100000100000100000100000100000100000";
+
+void init_inputs()
+{
+  srand48(1);
+  for (int i = 0; i < BENCH_INPUTS; ++i) {
+    g_x[i] = random_complex(1);
+    g_acj[i] = random_acj();
+  }
+  for (int i = 0; i < BENCH_INPUTS; ++i) {
+    // Determinant 1 up to the error terms
+    ACJ a = g_acj[i];
+    ACJ b = g_acj[(i + 1) % BENCH_INPUTS];
+    ACJ c = g_acj[(i + 2) % BENCH_INPUTS];
+    g_sl2[i] = SL2ACJ(a, b, c, (b * c + 1.) / a);
+  }
+  g_ctx.box = build_box(g_boxcode);
+  reset_context(g_ctx);
+}
+
+typedef void (*BenchFunc)(size_t n); // runs n operations
+
+void bench_xcomplex_add(size_t n)
+{
+  double sum = 0;
+  for (size_t i = 0; i < n; ++i) {
+    sum += (g_x[i % BENCH_INPUTS] + g_x[(i + 1) % BENCH_INPUTS]).e;
+  }
+  g_sink = sum;
+}
+
+void bench_xcomplex_mul(size_t n)
+{
+  double sum = 0;
+  for (size_t i = 0; i < n; ++i) {
+    sum += (g_x[i % BENCH_INPUTS] * g_x[(i + 1) % BENCH_INPUTS]).e;
+  }
+  g_sink = sum;
+}
+
+void bench_xcomplex_div(size_t n)
+{
+  double sum = 0;
+  for (size_t i = 0; i < n; ++i) {
+    sum += (g_x[i % BENCH_INPUTS] / g_x[(i + 1) % BENCH_INPUTS]).e;
+  }
+  g_sink = sum;
+}
+
+void bench_abs_ub(size_t n)
+{
+  double sum = 0;
+  for (size_t i = 0; i < n; ++i) {
+    sum += absUB(g_x[i % BENCH_INPUTS]);
+  }
+  g_sink = sum;
+}
+
+void bench_abs_lb(size_t n)
+{
+  double sum = 0;
+  for (size_t i = 0; i < n; ++i) {
+    sum += absLB(g_x[i % BENCH_INPUTS]);
+  }
+  g_sink = sum;
+}
+
+void bench_acj_add(size_t n)
+{
+  double sum = 0;
+  for (size_t i = 0; i < n; ++i) {
+    sum += (g_acj[i % BENCH_INPUTS] + g_acj[(i + 1) % BENCH_INPUTS]).e;
+  }
+  g_sink = sum;
+}
+
+void bench_acj_mul(size_t n)
+{
+  double sum = 0;
+  for (size_t i = 0; i < n; ++i) {
+    sum += (g_acj[i % BENCH_INPUTS] * g_acj[(i + 1) % BENCH_INPUTS]).e;
+  }
+  g_sink = sum;
+}
+
+void bench_acj_div(size_t n)
+{
+  double sum = 0;
+  for (size_t i = 0; i < n; ++i) {
+    sum += (g_acj[i % BENCH_INPUTS] / g_acj[(i + 1) % BENCH_INPUTS]).e;
+  }
+  g_sink = sum;
+}
+
+// The kernels picked by --simd, see simd.h
+void bench_kernel_mul(size_t n)
+{
+  double sum = 0;
+  for (size_t i = 0; i < n; ++i) {
+    sum += acj_mul(g_acj[i % BENCH_INPUTS], g_acj[(i + 1) % BENCH_INPUTS]).e;
+  }
+  g_sink = sum;
+}
+
+void bench_kernel_div(size_t n)
+{
+  double sum = 0;
+  for (size_t i = 0; i < n; ++i) {
+    sum += acj_div(g_acj[i % BENCH_INPUTS], g_acj[(i + 1) % BENCH_INPUTS]).e;
+  }
+  g_sink = sum;
+}
+
+void bench_sl2acj_mul(size_t n)
+{
+  double sum = 0;
+  for (size_t i = 0; i < n; ++i) {
+    sum += (g_sl2[i % BENCH_INPUTS] * g_sl2[(i + 1) % BENCH_INPUTS]).a.e;
+  }
+  g_sink = sum;
+}
+
+void bench_kernel_sl2acj_mul(size_t n)
+{
+  double sum = 0;
+  for (size_t i = 0; i < n; ++i) {
+    sum += sl2acj_mul(g_sl2[i % BENCH_INPUTS], g_sl2[(i + 1) % BENCH_INPUTS]).a.e;
+  }
+  g_sink = sum;
+}
+
+void bench_sl2acj_inverse(size_t n)
+{
+  double sum = 0;
+  for (size_t i = 0; i < n; ++i) {
+    sum += inverse(g_sl2[i % BENCH_INPUTS]).a.e;
+  }
+  g_sink = sum;
+}
+
+// Words as in the tree, G, g and the translations cached in the context of
+// the leaf as they are after its first word
+const char g_pattern[] = "GnGMgNgmGNNgMMgn";
+
+void bench_word(size_t n, size_t len)
+{
+  char word[65];
+  for (size_t i = 0; i < len; ++i) {
+    word[i] = g_pattern[i % (sizeof(g_pattern) - 1)];
+  }
+  word[len] = '\0';
+  double sum = 0;
+  for (size_t i = 0; i < n; ++i) {
+    sum += construct_word(g_ctx, word).a.e;
+  }
+  g_sink = sum;
+}
+
+void bench_word_4(size_t n) { bench_word(n, 4); }
+void bench_word_16(size_t n) { bench_word(n, 16); }
+void bench_word_64(size_t n) { bench_word(n, 64); }
+
+void bench_box(size_t n, size_t depth)
+{
+  char where[MAX_DEPTH];
+  strncpy(where, g_boxcode, depth);
+  where[depth] = '\0';
+  double sum = 0;
+  for (size_t i = 0; i < n; ++i) {
+    sum += build_box(where).cover.lattice.size;
+  }
+  g_sink = sum;
+}
+
+void bench_box_0(size_t n) { bench_box(n, 0); }
+void bench_box_30(size_t n) { bench_box(n, 30); }
+void bench_box_60(size_t n) { bench_box(n, 60); }
+
+// A depth 60 box around lattice 0.2 + 1.1i, loxodromic square root
+// 1.9 + 1.3i and parabolic 0.45 + 0.35i, with cusp area above e2_area_min
+char g_e2_boxcode[] = "111111000000000010110010000001011101011000111000100101010011";
+
+// A rect of the lattice cover around 0.53 + 0.125i, and words that kill it
+// on the e2 box. No rect around 0 = g(infinity) or another point of the
+// orbit of infinity with |c| as small as that of g is ever killed, so the
+// whole cover can't be.
+const char g_e2_rect[] = "11000000010";
+const char* g_e2_words[] = { "MgNg", "GnG", "GMg", "GG" };
+
+// On the e2 box and its parent two levels up, the search of the rect with
+// the words and no pool
+void bench_e2(size_t n, size_t depth)
+{
+  char where[MAX_DEPTH];
+  strncpy(where, g_e2_boxcode, depth);
+  where[depth] = '\0';
+  LeafContext ctx;
+  ctx.box = build_box(where);
+  Rect root = initial_lattice_cover();
+  for (size_t i = 0; g_e2_rect[i] != '\0'; ++i) {
+    root = child(root, g_e2_rect[i] - '0');
+  }
+  int num_words = sizeof(g_e2_words) / sizeof(g_e2_words[0]);
+  for (size_t i = 0; i < n; ++i) {
+    reset_context(ctx);
+    if (!no_e2_horoball(ctx, where, g_e2_words, num_words, root)) {
+      fprintf(stderr, "Fatal: the e2 words do not kill the rect at %s\n", where);
+      exit(3);
+    }
+  }
+}
+
+void bench_e2_58(size_t n) { bench_e2(n, 58); }
+void bench_e2_60(size_t n) { bench_e2(n, 60); }
+
+typedef struct {
+  const char* name;
+  BenchFunc func;
+} Bench;
+
+const Bench g_benches[] = {
+  {"xcomplex_add", bench_xcomplex_add},
+  {"xcomplex_mul", bench_xcomplex_mul},
+  {"xcomplex_div", bench_xcomplex_div},
+  {"absUB", bench_abs_ub},
+  {"absLB", bench_abs_lb},
+  {"acj_add", bench_acj_add},
+  {"acj_mul", bench_acj_mul},
+  {"acj_div", bench_acj_div},
+  {"kernel_acj_mul", bench_kernel_mul},
+  {"kernel_acj_div", bench_kernel_div},
+  {"sl2acj_mul", bench_sl2acj_mul},
+  {"kernel_sl2acj_mul", bench_kernel_sl2acj_mul},
+  {"sl2acj_inverse", bench_sl2acj_inverse},
+  {"construct_word_4", bench_word_4},
+  {"construct_word_16", bench_word_16},
+  {"construct_word_64", bench_word_64},
+  {"build_box_0", bench_box_0},
+  {"build_box_30", bench_box_30},
+  {"build_box_60", bench_box_60},
+  {"e2_horoball_58", bench_e2_58},
+  {"e2_horoball_60", bench_e2_60},
+};
+
+double now()
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + 1e-9 * t.tv_nsec;
+}
+
+// Doubles the round until it takes a tenth of seconds, then repeats it
+// for seconds. Returns the best nanoseconds per operation.
+double run_bench(BenchFunc func, double seconds, size_t* ops)
+{
+  size_t n = 1;
+  while (n < ((size_t) 1 << 32)) {
+    double start = now();
+    func(n);
+    if (now() - start >= seconds / 10) {
+      break;
+    }
+    n *= 2;
+  }
+  double best = 0;
+  *ops = 0;
+  double start = now();
+  do {
+    double round = now();
+    func(n);
+    double ns = 1e9 * (now() - round) / n;
+    if (*ops == 0 || ns < best) {
+      best = ns;
+    }
+    *ops += n;
+  } while (now() - start < seconds);
+  return best;
+}
+
+// Lines of earlier output, by name
+std::map<std::string, double> read_baseline(const char* path)
+{
+  std::map<std::string, double> baseline;
+  FILE* fp = fopen(path, "r");
+  if (fp == NULL) {
+    fprintf(stderr, "Fatal: cannot read baseline %s\n", path);
+    exit(2);
+  }
+  char line[256];
+  while (fgets(line, sizeof(line), fp)) {
+    char name[128];
+    double ns;
+    if (line[0] != '#' && sscanf(line, "%127s %lf", name, &ns) == 2) {
+      baseline[name] = ns;
+    }
+  }
+  fclose(fp);
+  return baseline;
+}
+
+int main(int argc, char** argv)
+{
+  double seconds = 0.2;
+  const char* filter = "";
+  const char* compare = 0;
+  const char* simd = 0;
+  static struct option long_options[] = {
+    {"simd", required_argument, 0, 'A'},
+    {0, 0, 0, 0}
+  };
+  int opt;
+  while ((opt = getopt_long(argc, argv, "t:f:c:", long_options, 0)) != -1) {
+    if (opt == 't') {
+      seconds = atof(optarg);
+    } else if (opt == 'f') {
+      filter = optarg;
+    } else if (opt == 'c') {
+      compare = optarg;
+    } else if (opt == 'A') {
+      simd = optarg;
+    } else {
+      break;
+    }
+  }
+  if (opt != -1 || optind != argc || !(seconds > 0) || !init_simd(simd)) {
+    fprintf(stderr, "Usage: %s [-t seconds] [-f name_filter] [-c baseline_file] "
+        "[--simd avx2|sse2|scalar]\n", argv[0]);
+    exit(1);
+  }
+  std::map<std::string, double> baseline;
+  if (compare) {
+    baseline = read_baseline(compare);
+  }
+
+  // roundoff_ok() would print to stdout
+  feclearexcept(FE_ALL_EXCEPT);
+  init_inputs();
+  printf("# name\tns_per_op\tops%s\n", compare ? "\tbaseline_ns\tratio" : "");
+  printf("# simd %s\n", g_simd.name);
+  size_t num_benches = sizeof(g_benches) / sizeof(g_benches[0]);
+  for (size_t i = 0; i < num_benches; ++i) {
+    const Bench& bench = g_benches[i];
+    if (!strstr(bench.name, filter)) {
+      continue;
+    }
+    size_t ops;
+    double ns = run_bench(bench.func, seconds, &ops);
+    printf("%s\t%.3f\t%lu", bench.name, ns, ops);
+    if (compare && baseline.count(bench.name)) {
+      double base = baseline[bench.name];
+      printf("\t%.3f\t%.3f", base, ns / base);
+    }
+    printf("\n");
+    fflush(stdout);
+  }
+  if (fetestexcept(FE_UNDERFLOW | FE_OVERFLOW)) {
+    printf("# underflow or overflow occurred\n");
+  }
+  exit(0);
+}
@@ -26,19 +26,19 @@ void compute_center_and_size(Box& box)
 
 void compute_cover(Box& box)
 {
-  box.cover.lattice = ACJ(
+  box.cover.lattice = make_jet<JET_F0>(
       XComplex(box.center[3], box.center[0]),
       XComplex(box.size[3], box.size[0]),
       0.,
       0.
       );
-  box.cover.loxodromic_sqrt = ACJ(
+  box.cover.loxodromic_sqrt = make_jet<JET_F1>(
       XComplex(box.center[4], box.center[1]),
       0.,
       XComplex(box.size[4], box.size[1]),
       0.
       );
-  box.cover.parabolic = ACJ(
+  box.cover.parabolic = make_jet<JET_F2>(
       XComplex(box.center[5], box.center[2]),
       0.,
       0.,
@@ -173,27 +173,34 @@ void compute_greater(Box& box)
   box.greater.parabolic = XComplex(m[5], m[2]);
 }
 
-Box build_box(char* where) {
-  Box box;
-  size_t pos = 0;
-  size_t idx = 0;
-  int dir;
-  while (where[idx] != '\0') {
-    if (where[idx] == '0') {
-      dir = 0;
-    } else if (where[idx] == '1') {
-      dir = 1;
-    } else {
+BoxDigits child(const BoxDigits& digits, int dir) {
+  BoxDigits child(digits);
+  child.size_digits[child.pos] *= 0.5;
+  child.center_digits[child.pos] += (2 * dir - 1) * child.size_digits[child.pos];
+  ++child.pos;
+  if (child.pos == 6) {
+    child.pos = 0;
+  }
+  return child;
+}
+
+BoxDigits box_digits(const char* where) {
+  BoxDigits digits;
+  for (size_t idx = 0; where[idx] != '\0'; ++idx) {
+    if (where[idx] != '0' && where[idx] != '1') {
       fprintf(stderr, "Fatal: boxcode is invalid %s\n", where);
       exit(6);
     }
-    box.size_digits[pos] *= 0.5;
-    box.center_digits[pos] += (2 * dir - 1) * box.size_digits[pos];
-    ++pos;
-    if (pos == 6) {
-      pos = 0;
-    }
-    ++idx;
+    digits = child(digits, where[idx] - '0');
+  }
+  return digits;
+}
+
+Box build_box(const BoxDigits& digits) {
+  Box box;
+  for (int i = 0; i < 6; ++i) {
+    box.center_digits[i] = digits.center_digits[i];
+    box.size_digits[i] = digits.size_digits[i];
   }
   compute_center_and_size(box);
   compute_cover(box);
@@ -203,6 +210,10 @@ Box build_box(char* where) {
   return box;    
 }
 
+Box build_box(char* where) {
+  return build_box(box_digits(where));
+}
+
 double rect_scale[2] = {
   pow(2., -0. / 2.),
   pow(2., -1. / 2.)
@@ -221,8 +232,8 @@ void compute_center_and_radius(Rect& rect) {
   }
   // Notice that the center and radius of a rect are constant and do not
   // depend on (z1, z2, z3). In particular, this is used like interval arithmetic.
-  rect.c = ACJ(XComplex(rect.center[1], rect.center[0]), 0., 0., 0.);
-  rect.r = ACJ(XComplex(rect.size[1],   rect.size[0]),   0., 0., 0.);
+  rect.c = make_jet<0>(XComplex(rect.center[1], rect.center[0]), 0., 0., 0.);
+  rect.r = make_jet<0>(XComplex(rect.size[1],   rect.size[0]),   0., 0., 0.);
 }
 
 Rect initial_lattice_cover() {
@@ -237,6 +248,7 @@ Rect child(const Rect& rect, int dir) {
 	child.center_digits[child.pos] += (2 * dir - 1) * child.size_digits[child.pos];
 	++child.pos;
 	if (child.pos == 2) { child.pos = 0; }
+  ++child.depth;
   compute_center_and_radius(child);
 	return child;
 }
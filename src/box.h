@@ -1,6 +1,11 @@
 #ifndef _box_h_
 #define _box_h_
 #include "SL2ACJ.h"
+#include "jet.h"
+
+// Deepest boxcode of the tree. Each dimension is halved at most 43 times,
+// so the digits of a box are exact doubles.
+#define MAX_DEPTH 256
 
 typedef struct {
   XComplex lattice;
@@ -8,10 +13,11 @@ typedef struct {
   XComplex parabolic;
 } XParams;
 
+// Each parameter varies in its own coordinates only, see jet.h
 typedef struct {
-  ACJ lattice;
-  ACJ loxodromic_sqrt;
-  ACJ parabolic;
+  Jet<JET_F0> lattice;
+  Jet<JET_F1> loxodromic_sqrt;
+  Jet<JET_F2> parabolic;
 } ACJParams;
 
 typedef struct {
@@ -34,6 +40,16 @@ typedef struct {
   XParams greater; // all values greater than in the box
 } Box;
 
+// The digits of a box, see Box below. A child box halves the size in the
+// next dimension and moves the center towards dir, exactly as build_box()
+// does for each character of the boxcode, so the traversal can carry the
+// digits down the tree one level at a time.
+typedef struct {
+  double center_digits[6] = {0, 0, 0, 0, 0, 0};
+  double size_digits[6] = {8, 8, 8, 8, 8, 8};
+  int pos = 0;
+} BoxDigits;
+
 typedef struct {
   // Initial disk:
   //    center at (0,0) and complex radius 8 * 2^(-1/2) + 8 * 2^0 i
@@ -43,11 +59,18 @@ typedef struct {
   double center[2];
   double size[2];
   int pos = 0;
-	ACJ c; // center
-	ACJ r; // radius
+  int depth = 0; // halvings since initial_lattice_cover()
+	Jet<0> c; // center
+	Jet<0> r; // radius
 } Rect;
 
+// Dimension i of a rect is its digits times rect_scale[i]
+extern double rect_scale[2];
+
 Box build_box(char* where);
+BoxDigits box_digits(const char* where);
+BoxDigits child(const BoxDigits& digits, int dir);
+Box build_box(const BoxDigits& digits);
 Rect initial_lattice_cover();
 Rect child(const Rect& disk, int dir);
 
@@ -0,0 +1,472 @@
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+#include "boxfile.h"
+
+#define MAX_BUF 1024
+#define TAR_BLOCK 512
+#define MAX_PREFETCH_SIZE (256 << 20)
+
+const char* g_tree_location;
+
+// Streams the concatenated contents of the regular files in a gzipped tar
+// archive, like tar -xOzf, without leaving the process.
+typedef struct {
+  gzFile gz;
+  size_t remaining; // bytes left in the current member
+  size_t padding;   // bytes from the end of the member to the next block
+  bool done;
+} TarStream;
+
+size_t tar_size(const unsigned char* header)
+{
+  // Sizes over 8GB are stored in base-256 with the high bit set
+  size_t size = 0;
+  if (header[124] & 0x80) {
+    for (int i = 125; i < 136; ++i) {
+      size = (size << 8) | header[i];
+    }
+    return size;
+  }
+  for (int i = 124; i < 136 && header[i] >= '0' && header[i] <= '7'; ++i) {
+    size = (size << 3) | (header[i] - '0');
+  }
+  return size;
+}
+
+bool tar_skip(gzFile gz, size_t len)
+{
+  unsigned char buf[TAR_BLOCK];
+  while (len > 0) {
+    int n = gzread(gz, buf, len < sizeof(buf) ? len : sizeof(buf));
+    if (n <= 0) {
+      return false;
+    }
+    len -= n;
+  }
+  return true;
+}
+
+// Advance to the next regular file member. Returns false at the end.
+bool tar_next(TarStream* ts)
+{
+  unsigned char header[TAR_BLOCK];
+  if (!tar_skip(ts->gz, ts->padding)) {
+    return false;
+  }
+  ts->padding = 0;
+  while (gzread(ts->gz, header, TAR_BLOCK) == TAR_BLOCK) {
+    if (header[0] == '\0') {
+      return false; // end of archive marker
+    }
+    size_t size = tar_size(header);
+    size_t padding = (TAR_BLOCK - size % TAR_BLOCK) % TAR_BLOCK;
+    char type = header[156];
+    if (type == '0' || type == '\0' || type == '7') {
+      ts->remaining = size;
+      ts->padding = padding;
+      return true;
+    }
+    // Skip directories, links and extended headers
+    if (!tar_skip(ts->gz, size + padding)) {
+      return false;
+    }
+  }
+  return false;
+}
+
+ssize_t tar_read(void* cookie, char* buf, size_t size)
+{
+  TarStream* ts = (TarStream*) cookie;
+  size_t total = 0;
+  while (total < size && !ts->done) {
+    if (ts->remaining == 0) {
+      if (!tar_next(ts)) {
+        ts->done = true;
+      }
+      continue;
+    }
+    size_t want = size - total < ts->remaining ? size - total : ts->remaining;
+    int n = gzread(ts->gz, buf + total, want);
+    if (n <= 0) {
+      fprintf(stderr, "Fatal: truncated archive member\n");
+      exit(2);
+    }
+    ts->remaining -= n;
+    total += n;
+  }
+  return total;
+}
+
+int tar_close(void* cookie)
+{
+  TarStream* ts = (TarStream*) cookie;
+  int status = gzclose(ts->gz);
+  free(ts);
+  return status == Z_OK ? 0 : EOF;
+}
+
+FILE* open_tar_gz(const char* file_name)
+{
+  gzFile gz = gzopen(file_name, "rb");
+  if (!gz) {
+    return 0;
+  }
+  gzbuffer(gz, STREAM_BUF);
+  TarStream* ts = (TarStream*) calloc(1, sizeof(TarStream));
+  ts->gz = gz;
+  cookie_io_functions_t io;
+  memset(&io, 0, sizeof(io));
+  io.read = tar_read;
+  io.close = tar_close;
+  FILE* fp = fopencookie(ts, "r", io);
+  if (fp) {
+    setvbuf(fp, NULL, _IOFBF, STREAM_BUF);
+  }
+  return fp;
+}
+
+// Opens the .out or .out.tar.gz file for boxcode, bypassing prefetch
+FILE* open_box_file(const char* boxcode)
+{
+  char file_boxcode[MAX_BOXCODE_LEN];
+  char file_name[MAX_BUF];
+  // Open the root file if empty
+  if (strlen(boxcode) == 0) {
+    strcpy(file_boxcode, "root");
+  } else {
+    strcpy(file_boxcode, boxcode);
+  }
+  // Look for a out file
+  sprintf(file_name, "%s/%s.out", g_tree_location, file_boxcode);
+  struct stat sb;
+  if (0 == stat(file_name, &sb)) {
+    FILE* fp = fopen(file_name, "r");
+    if (fp) {
+      setvbuf(fp, NULL, _IOFBF, STREAM_BUF);
+    }
+    return fp;
+  }
+  // Look for a gzipped out file
+  sprintf(file_name, "%s/%s.out.tar.gz", g_tree_location, file_boxcode);
+  if (0 == stat(file_name, &sb)) {
+    return open_tar_gz(file_name);
+  }
+  return 0;
+}
+
+// Hole files are opened in depth-first order, which is the lexicographic
+// order of their boxcodes. Worker threads decompress the next few hole
+// files from a directory listing into memory while the current one is
+// being printed. Before a file is read a worker reserves the most a file
+// may take, MAX_PREFETCH_SIZE or an equal share of the budget if less, so
+// the bytes held ahead of the reader never exceed the budget. Larger files
+// are left to be streamed directly by open_box.
+
+enum { PREFETCH_PENDING, PREFETCH_READY };
+
+typedef struct {
+  char* boxcode;
+  char* data;
+  size_t size;
+  int state;
+} Prefetch;
+
+typedef struct {
+  char* data;
+  size_t size;
+  size_t pos;
+} MemStream;
+
+Prefetch* g_prefetch = 0;
+size_t g_num_prefetch = 0;
+size_t g_prefetch_head = 0; // next slot the reader will consume
+size_t g_prefetch_next = 0; // next slot a worker will fill
+size_t g_prefetch_window = 0;
+size_t g_prefetch_budget = 0;
+size_t g_prefetch_bytes = 0; // held or reserved ahead of the reader
+size_t g_prefetch_file_max = 0;
+pthread_mutex_t g_prefetch_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t g_prefetch_cond = PTHREAD_COND_INITIALIZER;
+
+int compare_boxcodes(const void* a, const void* b)
+{
+  return strcmp(((const Prefetch*) a)->boxcode, ((const Prefetch*) b)->boxcode);
+}
+
+void list_hole_files()
+{
+  DIR* dir = opendir(g_tree_location);
+  if (!dir) {
+    return;
+  }
+  size_t capacity = 0;
+  struct dirent* entry;
+  while ((entry = readdir(dir))) {
+    const char* name = entry->d_name;
+    size_t len = strspn(name, "01");
+    if (len == 0 || (strcmp(name + len, ".out") != 0
+          && strcmp(name + len, ".out.tar.gz") != 0)) {
+      continue;
+    }
+    if (g_num_prefetch == capacity) {
+      capacity = capacity ? 2 * capacity : 1024;
+      g_prefetch = (Prefetch*) realloc(g_prefetch, capacity * sizeof(Prefetch));
+    }
+    Prefetch* p = &g_prefetch[g_num_prefetch++];
+    p->boxcode = strndup(name, len);
+    p->data = 0;
+    p->size = 0;
+    p->state = PREFETCH_PENDING;
+  }
+  closedir(dir);
+  qsort(g_prefetch, g_num_prefetch, sizeof(Prefetch), compare_boxcodes);
+}
+
+// Reads the whole hole file, or returns NULL if it is max_size or larger
+char* slurp_box(const char* boxcode, size_t max_size, size_t* size_ptr)
+{
+  FILE* fp = open_box_file(boxcode);
+  if (!fp) {
+    return 0;
+  }
+  size_t capacity = STREAM_BUF < max_size ? STREAM_BUF : max_size;
+  size_t size = 0;
+  char* data = (char*) malloc(capacity);
+  size_t n;
+  while ((n = fread(data + size, 1, capacity - size, fp)) > 0) {
+    size += n;
+    if (size == capacity) {
+      if (capacity >= max_size) {
+        free(data);
+        fclose(fp);
+        return 0;
+      }
+      capacity = 2 * capacity < max_size ? 2 * capacity : max_size;
+      data = (char*) realloc(data, capacity);
+    }
+  }
+  fclose(fp);
+  *size_ptr = size;
+  return (char*) realloc(data, size ? size : 1);
+}
+
+void* prefetch_worker(void* arg)
+{
+  pthread_mutex_lock(&g_prefetch_lock);
+  while (g_prefetch_next < g_num_prefetch) {
+    if (g_prefetch_next >= g_prefetch_head + g_prefetch_window
+        || g_prefetch_bytes + g_prefetch_file_max > g_prefetch_budget) {
+      pthread_cond_wait(&g_prefetch_cond, &g_prefetch_lock);
+      continue;
+    }
+    Prefetch* p = &g_prefetch[g_prefetch_next++];
+    g_prefetch_bytes += g_prefetch_file_max;
+    pthread_mutex_unlock(&g_prefetch_lock);
+    size_t size = 0;
+    char* data = slurp_box(p->boxcode, g_prefetch_file_max, &size);
+    pthread_mutex_lock(&g_prefetch_lock);
+    if (!data) {
+      size = 0;
+    }
+    g_prefetch_bytes -= g_prefetch_file_max - size;
+    p->data = data;
+    p->size = size;
+    p->state = PREFETCH_READY;
+    pthread_cond_broadcast(&g_prefetch_cond);
+  }
+  pthread_mutex_unlock(&g_prefetch_lock);
+  return 0;
+}
+
+void start_prefetch(int threads, size_t max_bytes, const char* first)
+{
+  // A budget below one buffer would hold no file
+  if (threads <= 0 || max_bytes < STREAM_BUF) {
+    return;
+  }
+  list_hole_files();
+  // Hole files before the first one opened are never needed
+  while (g_prefetch_head < g_num_prefetch &&
+      strcmp(g_prefetch[g_prefetch_head].boxcode, first) < 0) {
+    ++g_prefetch_head;
+  }
+  g_prefetch_next = g_prefetch_head;
+  g_prefetch_window = 2 * threads;
+  g_prefetch_budget = max_bytes;
+  g_prefetch_file_max = max_bytes / threads;
+  if (g_prefetch_file_max > MAX_PREFETCH_SIZE) {
+    g_prefetch_file_max = MAX_PREFETCH_SIZE;
+  } else if (g_prefetch_file_max < STREAM_BUF) {
+    g_prefetch_file_max = STREAM_BUF;
+  }
+  for (int i = 0; i < threads; ++i) {
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, prefetch_worker, NULL) != 0) {
+      fprintf(stderr, "Fatal: failed to start prefetch thread\n");
+      exit(2);
+    }
+    pthread_detach(thread);
+  }
+}
+
+ssize_t mem_read(void* cookie, char* buf, size_t size)
+{
+  MemStream* ms = (MemStream*) cookie;
+  size_t n = ms->size - ms->pos < size ? ms->size - ms->pos : size;
+  memcpy(buf, ms->data + ms->pos, n);
+  ms->pos += n;
+  return n;
+}
+
+int mem_close(void* cookie)
+{
+  MemStream* ms = (MemStream*) cookie;
+  free(ms->data);
+  free(ms);
+  return 0;
+}
+
+FILE* open_mem(char* data, size_t size)
+{
+  MemStream* ms = (MemStream*) malloc(sizeof(MemStream));
+  ms->data = data;
+  ms->size = size;
+  ms->pos = 0;
+  cookie_io_functions_t io;
+  memset(&io, 0, sizeof(io));
+  io.read = mem_read;
+  io.close = mem_close;
+  return fopencookie(ms, "r", io);
+}
+
+FILE* open_box(const char* boxcode)
+{
+  if (strlen(boxcode) == 0 || g_num_prefetch == 0) {
+    return open_box_file(boxcode);
+  }
+  char* data = 0;
+  size_t size = 0;
+  pthread_mutex_lock(&g_prefetch_lock);
+  // Drop listed files that the tree never referenced
+  while (g_prefetch_head < g_num_prefetch &&
+      strcmp(g_prefetch[g_prefetch_head].boxcode, boxcode) < 0) {
+    Prefetch* p = &g_prefetch[g_prefetch_head];
+    while (g_prefetch_head < g_prefetch_next && p->state != PREFETCH_READY) {
+      pthread_cond_wait(&g_prefetch_cond, &g_prefetch_lock);
+    }
+    free(p->data);
+    p->data = 0;
+    g_prefetch_bytes -= p->size;
+    ++g_prefetch_head;
+    if (g_prefetch_next < g_prefetch_head) {
+      g_prefetch_next = g_prefetch_head; // never hand it to a worker
+    }
+    pthread_cond_broadcast(&g_prefetch_cond);
+  }
+  if (g_prefetch_head < g_num_prefetch &&
+      strcmp(g_prefetch[g_prefetch_head].boxcode, boxcode) == 0) {
+    Prefetch* p = &g_prefetch[g_prefetch_head];
+    while (p->state != PREFETCH_READY) {
+      pthread_cond_wait(&g_prefetch_cond, &g_prefetch_lock);
+    }
+    data = p->data;
+    size = p->size;
+    p->data = 0;
+    g_prefetch_bytes -= p->size;
+    ++g_prefetch_head;
+    pthread_cond_broadcast(&g_prefetch_cond);
+  }
+  pthread_mutex_unlock(&g_prefetch_lock);
+  if (data) {
+    return open_mem(data, size);
+  }
+  return open_box_file(boxcode);
+}
+
+void open_box_files(const char* location)
+{
+  g_tree_location = location;
+}
+
+bool advance_boxcode(char* boxcode, size_t box_depth, size_t* depth, char node)
+{
+  if (node == 'X') {
+    boxcode[box_depth + *depth] = '0'; // descend via left branch
+    ++*depth;
+    boxcode[box_depth + *depth] = '\0';
+    return false;
+  }
+  // Go up as many nodes as necessary
+  for (; *depth > 0 && boxcode[box_depth + *depth - 1] == '1'; --*depth) {}
+  if (*depth > 0) {
+    boxcode[box_depth + *depth - 1] = '1'; // jump from left to right node
+    boxcode[box_depth + *depth] = '\0'; // truncate to keep box current
+    return false;
+  }
+  boxcode[box_depth] = '\0'; // truncate to keep box current
+  return true;
+}
+
+// Finds the deepest indexed node whose boxcode is a prefix of target
+bool find_index_entry(const char* target, IndexEntry* entry)
+{
+  char file_name[MAX_BUF];
+  sprintf(file_name, "%s/tree.idx", g_tree_location);
+  FILE* fp = fopen(file_name, "r");
+  if (!fp) {
+    return false;
+  }
+  bool found = false;
+  size_t found_depth = 0;
+  char buf[MAX_BUF];
+  char boxcode[MAX_BOXCODE_LEN];
+  char file[MAX_BOXCODE_LEN];
+  size_t offset, leaves;
+  while (fgets(buf, sizeof(buf), fp)) {
+    if (buf[0] == '#' ||
+        sscanf(buf, "%511s %511s %lu %lu", boxcode, file, &offset, &leaves) != 4) {
+      continue;
+    }
+    if (strcmp(boxcode, "root") == 0) {
+      boxcode[0] = '\0';
+    }
+    if (strcmp(file, "root") == 0) {
+      file[0] = '\0';
+    }
+    size_t depth = strlen(boxcode);
+    if (strncmp(boxcode, target, depth) == 0 && (!found || depth > found_depth)) {
+      free(entry->boxcode);
+      free(entry->file);
+      entry->boxcode = strdup(boxcode);
+      entry->file = strdup(file);
+      entry->offset = offset;
+      entry->leaves = leaves;
+      found = true;
+      found_depth = depth;
+    }
+  }
+  fclose(fp);
+  return found;
+}
+
+// Moves a stream to offset, reading through it if it cannot seek
+void skip_to(FILE* fp, size_t offset)
+{
+  if (offset == 0 || fseek(fp, offset, SEEK_SET) == 0) {
+    return;
+  }
+  char buf[MAX_BUF];
+  while (offset > 0) {
+    size_t n = fread(buf, 1, offset < sizeof(buf) ? offset : sizeof(buf), fp);
+    if (n == 0) {
+      fprintf(stderr, "Fatal: index offset past end of file\n");
+      exit(2);
+    }
+    offset -= n;
+  }
+}
@@ -0,0 +1,53 @@
+#ifndef _boxfile_h_
+#define _boxfile_h_
+#include <stdio.h>
+#include <stddef.h>
+
+// Access to the files of a tree directory. The tree is stored as root.out
+// and hole files boxcode.out or boxcode.out.tar.gz, each holding the
+// depth-first text of one subtree in which an H line stands for the
+// subtree stored in the hole file of that boxcode.
+
+#define MAX_BOXCODE_LEN 512
+#define STREAM_BUF (1 << 20)
+
+// Subtree index
+//
+// A tree directory may hold tree.idx, written by rootcat -x depth, with one
+// line per node at depth at most depth,
+//    boxcode file offset leaves
+// where file names the .out file holding the first line of the subtree,
+// offset is the byte offset of that line in the uncompressed file and
+// leaves counts the leaves of the subtree. The root is written as "root".
+typedef struct {
+  char* boxcode;
+  char* file;
+  size_t offset;
+  size_t start_leaves;
+  size_t leaves;
+} IndexEntry;
+
+void open_box_files(const char* location);
+
+// The default for the bytes of hole files decompressed ahead
+#define PREFETCH_BYTES ((size_t) 1 << 30)
+
+// Starts threads prefetching the hole files that come after first in
+// depth-first order, holding at most max_bytes of them in memory
+void start_prefetch(int threads, size_t max_bytes, const char* first);
+
+// Opens the subtree file for boxcode, or the root file if it is empty
+FILE* open_box(const char* boxcode);
+
+// Finds the deepest indexed node whose boxcode is a prefix of target
+bool find_index_entry(const char* target, IndexEntry* entry);
+
+// Moves a stream to offset, reading through it if it cannot seek
+void skip_to(FILE* fp, size_t offset);
+
+// Moves boxcode to the next node after a node of the given type, where
+// depth counts the levels below box_depth. Returns true once the subtree
+// at the first box_depth characters of boxcode is complete.
+bool advance_boxcode(char* boxcode, size_t box_depth, size_t* depth, char node);
+
+#endif // _boxfile_h_
@@ -0,0 +1,108 @@
+#include <fenv.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "checkpoint.h"
+
+const char* g_checkpoint_path = 0;
+const char* g_checkpoint_program = "";
+time_t g_checkpoint_time = 0;
+
+Checkpoint g_resume;
+bool g_resuming = false;
+bool g_reached = true;
+
+void init_checkpoints(const char* path, const char* program)
+{
+  g_checkpoint_path = path;
+  g_checkpoint_program = program;
+  g_checkpoint_time = time(NULL);
+}
+
+bool checkpoint_due()
+{
+  return g_checkpoint_path
+    && time(NULL) - g_checkpoint_time >= CHECKPOINT_INTERVAL;
+}
+
+void write_checkpoint(const char* next, size_t count, int fp_flags)
+{
+  char tmp_path[4096];
+  snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", g_checkpoint_path);
+  FILE* fp = fopen(tmp_path, "w");
+  if (!fp) {
+    fprintf(stderr, "Fatal: failed to write checkpoint %s\n", tmp_path);
+    exit(2);
+  }
+  fprintf(fp, "# %s checkpoint\n", g_checkpoint_program);
+  fprintf(fp, "next %s\n", strlen(next) ? next : "root");
+  fprintf(fp, "count %lu\n", count);
+  fprintf(fp, "fpflags %d\n", fp_flags);
+  if (fflush(fp) != 0 || fsync(fileno(fp)) != 0 || fclose(fp) != 0
+      || rename(tmp_path, g_checkpoint_path) != 0) {
+    fprintf(stderr, "Fatal: failed to write checkpoint %s\n", g_checkpoint_path);
+    exit(2);
+  }
+  g_checkpoint_time = time(NULL);
+}
+
+void resume_checkpoint(const char* boxcode)
+{
+  FILE* fp = fopen(g_checkpoint_path, "r");
+  if (!fp) {
+    fprintf(stderr, "Fatal: failed to open checkpoint %s\n", g_checkpoint_path);
+    exit(2);
+  }
+  char program[64];
+  bool valid = fscanf(fp, "# %63s checkpoint next %511s count %lu fpflags %d",
+      program, g_resume.next, &g_resume.count, &g_resume.fp_flags) == 4
+    && strcmp(program, g_checkpoint_program) == 0;
+  fclose(fp);
+  if (strcmp(g_resume.next, "root") == 0) {
+    g_resume.next[0] = '\0';
+  }
+  valid = valid && strspn(g_resume.next, "01") == strlen(g_resume.next)
+    && strncmp(g_resume.next, boxcode, strlen(boxcode)) == 0;
+  if (!valid) {
+    fprintf(stderr, "Fatal: invalid checkpoint %s\n", g_checkpoint_path);
+    exit(2);
+  }
+  if (g_resume.fp_flags & CHECKPOINT_FP_FLAGS) {
+    feraiseexcept(g_resume.fp_flags & CHECKPOINT_FP_FLAGS);
+  }
+  g_resuming = true;
+  g_reached = false;
+}
+
+bool before_checkpoint(const char* where)
+{
+  return g_resuming && strcmp(where, g_resume.next) < 0;
+}
+
+void reach_checkpoint(const char* where, size_t count)
+{
+  if (g_reached) {
+    return;
+  }
+  size_t len = strlen(g_resume.next);
+  // A subtree holding the checkpoint is checked by whoever walks it
+  if (strlen(where) < len && strncmp(where, g_resume.next, strlen(where)) == 0) {
+    return;
+  }
+  g_reached = true;
+  if (strncmp(where, g_resume.next, len) != 0 || count != g_resume.count) {
+    fprintf(stderr, "Fatal: checkpoint at %s does not match the tree\n",
+        g_resume.next);
+    exit(2);
+  }
+}
+
+void finish_checkpoints()
+{
+  if (g_checkpoint_path) {
+    unlink(g_checkpoint_path);
+  }
+}
@@ -0,0 +1,54 @@
+#ifndef _checkpoint_h_
+#define _checkpoint_h_
+#include <fenv.h>
+#include <stddef.h>
+
+// Checkpoints of a verify or identify run
+//
+// A checkpoint file records the boxcode of the first node not yet checked,
+// the number of leaves before it and the floating point exception flags
+// raised so far. Every leaf before that node in depth-first order, which is
+// every leaf whose boxcode compares less with strcmp, has been checked. The
+// file is text,
+//    # verify checkpoint
+//    next boxcode
+//    count leaves
+//    fpflags flags
+// where the root is written as "root". It is replaced atomically by rename.
+
+#define CHECKPOINT_INTERVAL 60 // seconds
+#define CHECKPOINT_FP_FLAGS (FE_UNDERFLOW | FE_OVERFLOW) // see roundoff_ok()
+
+typedef struct {
+  char next[512];
+  size_t count;
+  int fp_flags;
+} Checkpoint;
+
+// The checkpoint being resumed from
+extern Checkpoint g_resume;
+
+// Turns on checkpoints written to path by the named program
+void init_checkpoints(const char* path, const char* program);
+
+// True if checkpoints are on and the last one is CHECKPOINT_INTERVAL old
+bool checkpoint_due();
+
+void write_checkpoint(const char* next, size_t count, int fp_flags);
+
+// Loads the checkpoint of an earlier run, raising its flags in this thread.
+// Leaves before it are skipped until the run reaches the checkpoint.
+void resume_checkpoint(const char* boxcode);
+
+// True while resuming and where comes before the checkpoint
+bool before_checkpoint(const char* where);
+
+// Checks that the first node reached at or after the checkpoint starts the
+// checkpointed subtree with the checkpointed count of leaves before it.
+// Nothing is checked if where is an ancestor of the checkpoint.
+void reach_checkpoint(const char* where, size_t count);
+
+// Removes the checkpoint file after a successful run
+void finish_checkpoints();
+
+#endif // _checkpoint_h_
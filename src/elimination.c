@@ -1,10 +1,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <queue>
+#include <fenv.h>
+#include <algorithm>
 #include <vector>
 
 #include "elimination.h"
+#include "word.h"
 #include "e2_words.h"
 
 extern double max_area;
@@ -69,17 +71,62 @@ int g_length(char* word)
 // Returns the G SLACJ matrix
 SL2ACJ construct_G(const ACJParams& p)
 {
-  ACJ i(XComplex(0, 1));
-  const ACJ& P = p.parabolic;
-  const ACJ& S = p.loxodromic_sqrt;
-  return SL2ACJ((i * P) * S, i / S, i * S, ACJ(0));
+  Jet<0> i = make_jet<0>(XComplex(0, 1));
+  const Jet<JET_F2>& P = p.parabolic;
+  const Jet<JET_F1>& S = p.loxodromic_sqrt;
+  return SL2ACJ(acj((i * P) * S), acj(i / S), acj(i * S), ACJ(0));
 }
 
 // Lattice translation parameter: z -> z + T
 ACJ construct_T(const ACJParams& p, int M, int N)
 {
   // Note, int -> double conversion is exact
-  return p.lattice * double(N) + double(M);
+  return acj(p.lattice * double(N) + double(M));
+}
+
+void reset_context(LeafContext& ctx)
+{
+  ctx.have_G = false;
+  ctx.have_g = false;
+  ctx.num_T = 0;
+  ctx.num_powers = 0;
+  ctx.num_words = 0;
+  ctx.batch = NULL;
+  ctx.batch_size = 0;
+}
+
+const SL2ACJ& context_G(LeafContext& ctx)
+{
+  if (!ctx.have_G) {
+    ctx.G = construct_G(ctx.box.cover);
+    ctx.have_G = true;
+  }
+  return ctx.G;
+}
+
+const SL2ACJ& context_g(LeafContext& ctx)
+{
+  if (!ctx.have_g) {
+    ctx.g = inverse(context_G(ctx));
+    ctx.have_g = true;
+  }
+  return ctx.g;
+}
+
+// Once full, the cache replaces its entries in order
+const ACJ& context_T(LeafContext& ctx, int M, int N)
+{
+  int cached = ctx.num_T < T_CACHE ? ctx.num_T : T_CACHE;
+  for (int i = 0; i < cached; ++i) {
+    if (ctx.M[i] == M && ctx.N[i] == N) {
+      return ctx.T[i];
+    }
+  }
+  int i = ctx.num_T++ % T_CACHE;
+  ctx.M[i] = M;
+  ctx.N[i] = N;
+  ctx.T[i] = construct_T(ctx.box.cover, M, N);
+  return ctx.T[i];
 }
 
 // SL2ACJ matrix constrution from parameters and a word.
@@ -87,42 +134,37 @@ ACJ construct_T(const ACJParams& p, int M, int N)
 // We have chosen a right to left order of multiplication for validation to pass.
 // Different orders of multiplication produce slightly different rounding
 // errors. Since our data is greedy, this order is necessary for all words.
-SL2ACJ construct_word(const ACJParams& p, const char* word)
+// The word is compiled once per thread, see word.h.
+SL2ACJ construct_word(LeafContext& ctx, const char* word)
 {
-  ACJ one(1), zero(0);
-  SL2ACJ w(one, zero, zero, one);
-  SL2ACJ G(construct_G(p));
-  SL2ACJ g(inverse(G));
-
-  int M = 0;
-  int N = 0;
-  ACJ T;
-  size_t pos;
-  for (pos = strlen(word); pos > 0; --pos) {
-    char h = word[pos-1];
-    switch(h) {
-      case 'm': --M; break;
-      case 'M': ++M; break;
-      case 'n': --N; break;
-      case 'N': ++N; break;
-      default: {
-                 if (M != 0 || N != 0) {
-                   T = construct_T(p, M, N);
-                   w = SL2ACJ(w.a + T * w.c, w.b + T * w.d, w.c, w.d);
-                   M = N = 0;
-                 }
-                 if (h == 'g')
-                   w = g * w;
-                 else if (h == 'G')
-                   w = G * w;
-               }
-    }
+  return run_word_ops(ctx, word_program(intern_word(word)));
+}
+
+// Whether test holds for the matrix of word. Words are first evaluated by
+// their plan, see context_word(), and words with a plan again in the order
+// above if the test fails there. Either matrix bounds the word over the
+// whole box, so a test that holds for one is proved. The flags of the plan
+// and of its test are only raised if the test holds there. The matrix may
+// be cached from a plan the word has lost since, see word.h.
+bool word_holds(LeafContext& ctx, const char* word, WordTest test)
+{
+  int index = intern_word(word);
+  const WordProgram* program = word_program(index);
+  int held = 0;
+  const SL2ACJ& w = context_word(ctx, index, &held);
+  if (program->num_steps == 0 && held == 0) {
+    return test(ctx, w);
   }
-  if (M != 0 || N != 0) {
-    T = construct_T(p, M, N);
-    w = SL2ACJ(w.a + T * w.c, w.b + T * w.d, w.c, w.d);
+  fexcept_t flags;
+  fegetexceptflag(&flags, FE_UNDERFLOW | FE_OVERFLOW);
+  if (test(ctx, w)) {
+    if (held) {
+      feraiseexcept(held);
+    }
+    return true;
   }
-  return w;
+  fesetexceptflag(&flags, FE_UNDERFLOW | FE_OVERFLOW);
+  return test(ctx, run_word_ops(ctx, program));
 }
 
 // Cusp area lower bound
@@ -155,37 +197,36 @@ inline const double areaLB(const XParams& nearer, char* where)
 // 4. Im(parabolic) <= Im(lattice)/2
 // 5. Re(parabolic) <= 1/2
 // 6. |lox_sqrt^2| Im(L) <= max_area (area of fundamental paralleogram)
-void verify_out_of_bounds(char* where, char bounds_code)
+void verify_out_of_bounds(LeafContext& ctx, char* where, char bounds_code)
 {
-    Box box = build_box(where);
     switch(bounds_code) {
         case '0': {
-            check(absUB(box.further.loxodromic_sqrt) < 1, where);
+            check(absUB(ctx.box.further.loxodromic_sqrt) < 1, where);
             break; }
         case '1': {
-            check(box.greater.loxodromic_sqrt.im < 0
-             || box.greater.lattice.im < 0
-             || box.greater.parabolic.im < 0
-             || box.greater.parabolic.re < 0, where);
+            check(ctx.box.greater.loxodromic_sqrt.im < 0
+             || ctx.box.greater.lattice.im < 0
+             || ctx.box.greater.parabolic.im < 0
+             || ctx.box.greater.parabolic.re < 0, where);
             break; }
         case '2': {
-            check(fabs(box.nearer.lattice.re) > 0.5, where);
+            check(fabs(ctx.box.nearer.lattice.re) > 0.5, where);
             break; }
         case '3': {
-            check(absUB(box.further.lattice) < 1, where);
+            check(absUB(ctx.box.further.lattice) < 1, where);
             break; }
         case '4': {
             // Note: we can exclude the box if and only if the parabolic
             // imag part is bigger than half the lattice imag part over 
             // the entire box
             // Multiplication by 0.5 is EXACT (if no underflow or overflow)
-            check(box.nearer.parabolic.im > 0.5 * box.further.lattice.im, where);
+            check(ctx.box.nearer.parabolic.im > 0.5 * ctx.box.further.lattice.im, where);
             break; }
         case '5': {
-            check(box.nearer.parabolic.re > 0.5, where);
+            check(ctx.box.nearer.parabolic.re > 0.5, where);
             break; }
         case '6': {
-            double area = areaLB(box.nearer, where);
+            double area = areaLB(ctx.box.nearer, where);
             check(area > max_area, where);
             break;
         }
@@ -223,49 +264,54 @@ const bool large_horoball(const SL2ACJ& x, const ACJParams& p) {
 // Conditions checked:
 //  1) word is not a parabolic fixing infinity anywhere in the box
 //  2) word(infinity_horoball) intersects infinity_horoball
-void verify_large_horoball(char* where, char* word)
+bool large_horoball_test(LeafContext& ctx, const SL2ACJ& w)
+{
+    return large_horoball(w, ctx.box.cover) && not_parabolic_at_inf(w);
+}
+
+void verify_large_horoball(LeafContext& ctx, char* where, char* word)
 {
-    Box box = build_box(where);
-    SL2ACJ w = construct_word(box.cover, word);
+    check(word_holds(ctx, word, large_horoball_test), where);
+}
 
-    check(large_horoball(w, box.cover), where);
-    check(not_parabolic_at_inf(w), where);
+bool horoball_test(LeafContext& ctx, const SL2ACJ& w)
+{
+    return large_horoball(w, ctx.box.cover);
 }
 
 // Conditions checked:
 //  1) word has non-zero g-length at most g_len
 //  2) word(infinity_horoball) intersects infinity_horoball
-void verify_g_length(char* where, char* word, int g_len)
+void verify_g_length(LeafContext& ctx, char* where, char* word, int g_len)
 {
-    Box box = build_box(where);
-    SL2ACJ w = construct_word(box.cover, word);
-
     check(g_length(word) > 0, where);
     check(g_length(word) <= g_len, where);
-    check(large_horoball(w, box.cover), where);
+    check(word_holds(ctx, word, horoball_test), where);
 }
 
 // Conditions checked:
 //  1) the box is inside the variety neighborhood for given word
-void verify_variety(char* where, char* word)
+bool variety_test(LeafContext& ctx, const SL2ACJ& w)
 {
-    Box box = build_box(where);
-    SL2ACJ w = construct_word(box.cover, word);
+    return (absUB(w.c) < 1) && (absUB(w.b) < 1 || absLB(w.c) > 0);
+}
 
-    check((absUB(w.c) < 1) && (absUB(w.b) < 1 || absLB(w.c) > 0), where);
+void verify_variety(LeafContext& ctx, char* where, char* word)
+{
+    check(word_holds(ctx, word, variety_test), where);
 }
 
 // Conditions checked:
 //  1) word has non-zero g-length at most g_len
 //  2) the box is inside the variety neighborhood for given word
-void verify_variety_g_length(char* where, char* word, int g_len)
+void verify_variety_g_length(LeafContext& ctx, char* where, char* word, int g_len)
 {
     check(g_length(word) > 0, where);
     check(g_length(word) <= g_len, where);
-    verify_variety(where, word);
+    verify_variety(ctx, where, word);
 }
 
-void verify_bad_elliptic(char* where, char* word, char* core) {
+void verify_bad_elliptic(LeafContext& ctx, char* where, char* word, char* core) {
   // TODO FIXME
   check(true, where);
 }
@@ -273,20 +319,22 @@ void verify_bad_elliptic(char* where, char* word, char* core) {
 // Conditions checked:
 //  1) word(infinity_horoball) intersects infinity_horoball
 //  2) if word is parabolic fixing inf, it would be too short 
-void verify_short_parabolic(char* where, char* word)
+bool short_parabolic_test(LeafContext& ctx, const SL2ACJ& w)
 {
-    Box box = build_box(where);
-    SL2ACJ w = construct_word(box.cover, word);
+    return large_horoball(w, ctx.box.cover)
+        && absUB(w.b) < 1 && absLB(w.b) > 0;
+}
 
-    check(large_horoball(w, box.cover), where);
-    check(absUB(w.b) < 1 && absLB(w.b) > 0, where);
+void verify_short_parabolic(LeafContext& ctx, char* where, char* word)
+{
+    check(word_holds(ctx, word, short_parabolic_test), where);
 }
 
-void verify_bad_parabolic(char* where, char* word)
+bool bad_parabolic_test(LeafContext& ctx, const SL2ACJ& w)
 {
-    Box box = build_box(where);
-    SL2ACJ w = construct_word(box.cover, word);
-    check(large_horoball(w, box.cover), where);
+    if (!large_horoball(w, ctx.box.cover)) {
+        return false;
+    }
 
     // Tests if w hits any lattice points (when w is parabolic).
     // This test is inconclusive is w has large transtalion (i.e. translate
@@ -294,8 +342,10 @@ void verify_bad_parabolic(char* where, char* word)
 
     double one = 1; // Exact
     // We check the box is small enough to determine the sign of translation
-    check((absUB(w.d - one) < 2 || absUB(w.d + one) < 2 || 
-           absUB(w.a - one) < 2 || absUB(w.a + one) < 2 ), where);
+    if (!(absUB(w.d - one) < 2 || absUB(w.d + one) < 2 || 
+          absUB(w.a - one) < 2 || absUB(w.a + one) < 2 )) {
+        return false;
+    }
 
     // For all parabolic points in the box, we want verify
     // that none of them are lattice points. At such a point w.a = +/- 1, so
@@ -315,26 +365,29 @@ void verify_bad_parabolic(char* where, char* word)
     // take absolute values at the end.
 
     ACJ T = (absUB(w.d - one) < 2 || absUB(w.a - one) < 2) ? w.b : -w.b;
-    ACJ L = box.cover.lattice;
+    const Jet<JET_F0>& L = ctx.box.cover.lattice;
 
     ACJ d1 = T / (L + one);
     ACJ d2 = d1 - one;
     ACJ d3 = (T - one) / (L - one);
     ACJ d4 = d3 - one;
 
-    check(absUB(d1) < 1, where);
-    check(absUB(d2) < 1, where);
-    check(absUB(d3) < 1, where);
-    check(absUB(d4) < 1, where);
+    return absUB(d1) < 1 && absUB(d2) < 1 && absUB(d3) < 1 && absUB(d4) < 1;
+}
+
+void verify_bad_parabolic(LeafContext& ctx, char* where, char* word)
+{
+    check(word_holds(ctx, word, bad_parabolic_test), where);
 }
 
 // Returns true if image of the infinity horoball under w
 // is smaller than a required e2 ball
-const bool smaller_than_e2_horoball(SL2ACJ& x, const ACJParams& p) {
+const bool smaller_than_e2_horoball(const SL2ACJ& x, const ACJParams& p) {
   return absUB(p.loxodromic_sqrt / x.c) < one_over_e2_min;
 }
 
-const bool disk_killed_by_word(ACJ& center, ACJ& radius, const SL2ACJ& x) {
+const bool disk_killed_by_word(const Jet<0>& center, const Jet<0>& radius,
+    const SL2ACJ& x) {
   // Returns true if the disk is contained in the "kill radius"
   // of the horoball w(H_infty). A horoball of height h and center q
   // will interesect w(H_infty) if:
@@ -347,59 +400,298 @@ const bool disk_killed_by_word(ACJ& center, ACJ& radius, const SL2ACJ& x) {
                     + absUB(x.c * radius)) < one_over_e2_min; 
 }
 
-void verify_no_e2_horoball(char* where) {
-    Box box = build_box(where);
-    XComplex nL = box.nearer.lattice;
-    XComplex fL = box.further.lattice;
+// Checks that the rect misses the fundamental domain of the lattice
+const bool outside_lattice(const Rect& rect, const XComplex& nL, const XComplex& fL) {
+    const Jet<0>& c = rect.c;
+    const Jet<0>& r = rect.r;
+    return // Check rect is below x-axis
+           (c.f.im < 0 && (1 + EPS) * (absUB(r) + c.f.im) < 0)
+        || // Check rect is above y = im L
+           (fL.im > 0 && c.f.im > fL.im &&
+           (1 + 2 * EPS) * (absUB(r) + (fL.im - c.f.im)) < 0)
+        || // Check if re L > 0 and rect is left of x = 0
+           (nL.re > 0 && c.f.re < 0 &&
+           (1 + EPS) * (absUB(r) + c.f.re) < 0)
+        || // Check if re L < 0 and rect is right of x = 1
+           (nL.re < 0 && c.f.re > 1 &&
+           (1 + 2 * EPS) * (absUB(r) + (1 - c.f.re)) < 0)
+        || // Check if re L < 0 and rect is left of x = re L
+           (fL.re < 0 && c.f.re < fL.re &&
+           (1 + 2 * EPS) * ((absUB(r) - fL.re) + c.f.re) < 0)
+        || // Chek if re L > 0 and rect is right of x = 1 + re L 
+           (fL.re > 0 && c.f.re > 1 + fL.re &&
+           (1 + 2 * EPS) * ((fL.re + 1) + (absUB(r) - c.f.re)) < 0);
+}
 
-    std::vector<SL2ACJ> e2_mats;
-    for (int i = 0; i < NUM_E2_WORDS; ++i) {
-        e2_mats.push_back(construct_word(box.cover, e2_words[i]));
+// The killers of each cell of the grid, in order, as ranges of words, and
+// the cells of each killer, as ranges of cells along each dimension
+typedef struct {
+    std::vector<int> start; // E2_GRID * E2_GRID + 1
+    std::vector<int> words;
+    std::vector<int> lo[2];
+    std::vector<int> hi[2];
+} KillGrid;
+
+// The cell of digit d in [-8, 8] along one dimension. Adding 8 and the
+// power of two scaling are exact.
+int grid_cell(double d) {
+    double cell = floor((d + 8) * (E2_GRID / 16.));
+    if (!(cell >= 0)) {
+        return 0;
     }
+    return cell < E2_GRID ? int(cell) : E2_GRID - 1;
+}
 
-    std::queue<Rect> lattice_cover;
-    lattice_cover.push(initial_lattice_cover());
-    while (!lattice_cover.empty()) {
-        bool rect_killed = false;
-        Rect current = lattice_cover.front();
-        ACJ c = current.c;
-        ACJ r = current.r;
-        if (// Check rect is below x-axis
-            (c.f.im < 0 && (1 + EPS) * (absUB(r) + c.f.im) < 0)
-         || // Check rect is above y = im L
-            (fL.im > 0 && c.f.im > fL.im &&
-            (1 + 2 * EPS) * (absUB(r) + (fL.im - c.f.im)) < 0)
-         || // Check if re L > 0 and rect is left of x = 0
-            (nL.re > 0 && c.f.re < 0 &&
-            (1 + EPS) * (absUB(r) + c.f.re) < 0)
-         || // Check if re L < 0 and rect is right of x = 1
-            (nL.re < 0 && c.f.re > 1 &&
-            (1 + 2 * EPS) * (absUB(r) + (1 - c.f.re)) < 0)
-         || // Check if re L < 0 and rect is left of x = re L
-            (fL.re < 0 && c.f.re < fL.re &&
-            (1 + 2 * EPS) * ((absUB(r) - fL.re) + c.f.re) < 0)
-         || // Chek if re L > 0 and rect is right of x = 1 + re L 
-            (fL.re > 0 && c.f.re > 1 + fL.re &&
-            (1 + 2 * EPS) * ((fL.re + 1) + (absUB(r) - c.f.re)) < 0))
-        {
-          rect_killed = true;
-        } else { 
-            double area_lb = areaLB(box.nearer, where);
-            if (area_lb >= e2_area_min) {
-                for (SL2ACJ w : e2_mats) {
-                    if (smaller_than_e2_horoball(w, box.cover) &&
-                        disk_killed_by_word(c, r, w))
-                    {
-                        rect_killed = true;
-                        break;
-                    }
-                }
+int rect_cell(const Rect& rect) {
+    return grid_cell(rect.center_digits[1]) * E2_GRID
+         + grid_cell(rect.center_digits[0]);
+}
+
+// disk_killed_by_word() needs absUB(a - c q) < one_over_e2_min at the
+// center q of the rect, and |a.f - c.f q| is at most that up to rounding,
+// so q lies within one_over_e2_min / |c.f| of a.f / c.f. The disk is
+// widened well beyond the rounding, and words with a degenerate disk go in
+// every cell. The grid only picks the words to try, so its arithmetic is
+// not rigorous, and the flags it raises are dropped.
+void build_grid(KillGrid& grid, const std::vector<SL2ACJ>& killers) {
+    fexcept_t flags;
+    fegetexceptflag(&flags, FE_ALL_EXCEPT);
+    std::vector<int>* lo = grid.lo;
+    std::vector<int>* hi = grid.hi;
+    for (size_t k = 0; k < killers.size(); ++k) {
+        XComplex a = killers[k].a.f;
+        XComplex c = killers[k].c.f;
+        double norm = c.re * c.re + c.im * c.im;
+        XComplex p((a.re * c.re + a.im * c.im) / norm,
+                   (a.im * c.re - a.re * c.im) / norm);
+        double radius = (1 + 1e-6) * one_over_e2_min / sqrt(norm) + 1e-6;
+        // Digits 1 and 0 of a rect give its real and imaginary parts
+        double center[2] = { p.im, p.re };
+        for (int i = 0; i < 2; ++i) {
+            double low = (center[i] - radius) / rect_scale[i];
+            double high = (center[i] + radius) / rect_scale[i];
+            if (!(low <= high) || high - low > 32) { // NaN or infinite too
+                low = -8;
+                high = 8;
+            }
+            lo[i].push_back(grid_cell(low));
+            hi[i].push_back(grid_cell(high));
+            if (high < -8 || low > 8) {
+                lo[i].back() = 1;
+                hi[i].back() = 0;
             }
         }
-        if (!rect_killed) {
-            lattice_cover.push(child(current, 0));
-            lattice_cover.push(child(current, 1));
+    }
+    grid.start.assign(E2_GRID * E2_GRID + 1, 0);
+    for (size_t k = 0; k < killers.size(); ++k) {
+        for (int i = lo[1][k]; i <= hi[1][k]; ++i) {
+            for (int j = lo[0][k]; j <= hi[0][k]; ++j) {
+                ++grid.start[i * E2_GRID + j + 1];
+            }
         }
-        lattice_cover.pop();
     }
+    for (int cell = 0; cell < E2_GRID * E2_GRID; ++cell) {
+        grid.start[cell + 1] += grid.start[cell];
+    }
+    grid.words.resize(grid.start[E2_GRID * E2_GRID]);
+    std::vector<int> next(grid.start.begin(), grid.start.end() - 1);
+    for (size_t k = 0; k < killers.size(); ++k) {
+        for (int i = lo[1][k]; i <= hi[1][k]; ++i) {
+            for (int j = lo[0][k]; j <= hi[0][k]; ++j) {
+                grid.words[next[i * E2_GRID + j]++] = int(k);
+            }
+        }
+    }
+    fesetexceptflag(&flags, FE_ALL_EXCEPT);
+}
+
+bool in_cell(const KillGrid& grid, int k, int cell) {
+    int i = cell / E2_GRID;
+    int j = cell % E2_GRID;
+    return grid.lo[1][k] <= i && i <= grid.hi[1][k]
+        && grid.lo[0][k] <= j && j <= grid.hi[0][k];
+}
+
+// The e2 words that killed rects last on this thread, most recent first,
+// plus one, or 0. Kept from leaf to leaf, since neighboring rects and boxes
+// are mostly killed by the same few words.
+__thread int t_recent[E2_RECENT];
+
+void move_to_front(int word) {
+    int i = 0;
+    while (i < E2_RECENT - 1 && t_recent[i] != word + 1) {
+        ++i;
+    }
+    for (; i > 0; --i) {
+        t_recent[i] = t_recent[i - 1];
+    }
+    t_recent[0] = word + 1;
+}
+
+Pool* g_e2_pool = 0;
+
+// The search of the lattice cover of one leaf. Its tasks share the
+// killers and their grid read-only and stop once one of them has failed.
+typedef struct {
+    XComplex nL;
+    XComplex fL;
+    const std::vector<SL2ACJ>* killers;
+    const std::vector<int>* killer_words; // the e2 word of each killer
+    std::vector<int> word_killers; // the killer of each e2 word, or -1
+    const KillGrid* grid;
+    Pool* pool;
+    TaskGroup group;
+    bool failed;
+} CoverSearch;
+
+typedef struct {
+    CoverSearch* search;
+    Rect rect;
+} RectTask;
+
+void search_task(void* arg);
+
+// Pending rects of the lattice cover, E2_MAX_DEPTH + 1 per thread
+__thread Rect* t_rects = 0;
+
+// Checks that every rect below root is outside the fundamental domain or
+// killed by one of the killers, subdividing the ones that are not at most
+// E2_MAX_DEPTH times. Depth-first, a rect is pending only if it is the
+// sibling of one of the rects being subdivided, so the stack holds at most
+// one rect per depth and one more. With a pool, every E2_TASK_RECTS rects
+// the pending rects become tasks, shallowest and so largest first, and
+// only the current one, the deepest and smallest, stays on this thread.
+void search_cover(CoverSearch* search, const Rect& root) {
+    Rect* stack = t_rects;
+    if (stack == NULL) {
+        stack = t_rects = new Rect[E2_MAX_DEPTH + 1];
+    }
+    size_t top = 0;
+    stack[top++] = root;
+    size_t rects = 0;
+    while (top > 0) {
+        if (__atomic_load_n(&search->failed, __ATOMIC_RELAXED)) {
+            return;
+        }
+        if (search->pool && ++rects % E2_TASK_RECTS == 0 && top > 1) {
+            for (size_t i = 0; i + 1 < top; ++i) {
+                RectTask* task = new RectTask;
+                task->search = search;
+                task->rect = stack[i];
+                submit_group_task(search->pool, &search->group, search_task, task);
+            }
+            stack[0] = stack[top - 1];
+            top = 1;
+        }
+        const Rect& current = stack[top - 1];
+        const std::vector<SL2ACJ>& killers = *search->killers;
+        const KillGrid& grid = *search->grid;
+        bool rect_killed = outside_lattice(current, search->nL, search->fL);
+        int cell = rect_cell(current);
+        // The recent killers first, then the rest of the cell. Any killer
+        // proves the rect, so the order only changes the work.
+        int tried[E2_RECENT];
+        int num_tried = 0;
+        int killer = -1;
+        for (int i = 0; !rect_killed && i < E2_RECENT; ++i) {
+            // Recent words may be of another list, see no_e2_horoball()
+            size_t word = t_recent[i];
+            int k = word == 0 || word > search->word_killers.size()
+                ? -1 : search->word_killers[word - 1];
+            if (k >= 0 && in_cell(grid, k, cell)) {
+                tried[num_tried++] = k;
+                rect_killed = disk_killed_by_word(current.c, current.r, killers[k]);
+                killer = k;
+            }
+        }
+        for (int i = grid.start[cell]; !rect_killed && i < grid.start[cell + 1]; ++i) {
+            int k = grid.words[i];
+            if (std::find(tried, tried + num_tried, k) == tried + num_tried) {
+                rect_killed = disk_killed_by_word(current.c, current.r, killers[k]);
+                killer = k;
+            }
+        }
+        if (rect_killed && killer >= 0) {
+            move_to_front((*search->killer_words)[killer]);
+        }
+        if (rect_killed) {
+            --top;
+            continue;
+        }
+        if (current.depth == E2_MAX_DEPTH) {
+            __atomic_store_n(&search->failed, true, __ATOMIC_RELAXED);
+            return;
+        }
+        stack[top] = child(current, 1);
+        stack[top - 1] = child(current, 0);
+        ++top;
+    }
+}
+
+void search_task(void* arg) {
+    RectTask* task = (RectTask*) arg;
+    search_cover(task->search, task->rect);
+    delete task;
+}
+
+// Whether the whole lattice cover is killed. The waiting thread runs
+// tasks of the search, and no others, see wait_group().
+bool lattice_cover_killed(const XComplex& nL, const XComplex& fL,
+    const std::vector<SL2ACJ>& killers, const std::vector<int>& killer_words,
+    int num_words, const Rect& root) {
+    KillGrid grid;
+    build_grid(grid, killers);
+    CoverSearch search;
+    search.nL = nL;
+    search.fL = fL;
+    search.killers = &killers;
+    search.killer_words = &killer_words;
+    search.word_killers.assign(num_words, -1);
+    for (size_t k = 0; k < killer_words.size(); ++k) {
+        search.word_killers[killer_words[k]] = int(k);
+    }
+    search.grid = &grid;
+    search.pool = g_e2_pool;
+    search.group.pending = 0;
+    search.group.fp_flags = 0;
+    search.failed = false;
+    search_cover(&search, root);
+    if (search.pool) {
+        wait_group(search.pool, &search.group);
+    }
+    return !search.failed;
+}
+
+bool no_e2_horoball(LeafContext& ctx, char* where, const char* const* words,
+    int num_words, const Rect& root) {
+    XComplex nL = ctx.box.nearer.lattice;
+    XComplex fL = ctx.box.further.lattice;
+
+    std::vector<SL2ACJ> e2_mats;
+    e2_mats.reserve(num_words);
+    for (int i = 0; i < num_words; ++i) {
+        e2_mats.push_back(construct_word(ctx, words[i]));
+    }
+
+    // The area and the size of the image horoballs depend on the box alone,
+    // so only the words that can kill some disk are tried on the rects
+    std::vector<SL2ACJ> killers;
+    std::vector<int> killer_words;
+    double area_lb = areaLB(ctx.box.nearer, where);
+    if (area_lb >= e2_area_min) {
+        killers.reserve(num_words);
+        for (size_t i = 0; i < e2_mats.size(); ++i) {
+            if (smaller_than_e2_horoball(e2_mats[i], ctx.box.cover)) {
+                killers.push_back(e2_mats[i]);
+                killer_words.push_back(int(i));
+            }
+        }
+    }
+
+    return lattice_cover_killed(nL, fL, killers, killer_words, num_words, root);
+}
+
+void verify_no_e2_horoball(LeafContext& ctx, char* where) {
+    check(no_e2_horoball(ctx, where, e2_words, NUM_E2_WORDS,
+        initial_lattice_cover()), where);
 }
@@ -1,8 +1,8 @@
 #ifndef _elimination_h_
 #define _elimination_h_
 #include "box.h"
+#include "pool.h"
 
-#define MAX_DEPTH 256
 #define MAX_CODE_LEN 512
 
 // Helper functions
@@ -21,16 +21,68 @@ word_pair get_word_pair(char* code);
 int g_length(char* word);
 
 // Elimination functions
+//
+// Each takes the context of the leaf at where, see LeafContext
 
 SL2ACJ construct_G(const ACJParams& params);
 
 ACJ construct_T(const ACJParams& params, int M, int N);
 
-SL2ACJ construct_word(const ACJParams& params, const char* word);
+#define T_CACHE 8
+#define POWER_CACHE 8
+#define WORD_CACHE 2
+
+// The state shared by the checks of one leaf: its box, and G, g, the last
+// T_CACHE lattice translations, the last POWER_CACHE blocks and powers and
+// the last WORD_CACHE words, see word.h, built from box.cover on first
+// use, so the words of a leaf reuse them. The leaves of a batch have the
+// same line, and their words are evaluated together, see context_word().
+// Contexts are reused from leaf to leaf, see reset_context().
+struct LeafContext {
+  Box box;
+  SL2ACJ G;
+  SL2ACJ g;
+  bool have_G;
+  bool have_g;
+  int num_T;
+  int M[T_CACHE];
+  int N[T_CACHE];
+  ACJ T[T_CACHE];
+  int num_powers;
+  int block[POWER_CACHE];
+  int exponent[POWER_CACHE];
+  SL2ACJ power[POWER_CACHE];
+  int power_flags[POWER_CACHE]; // held, see context_word()
+  int num_words;
+  int word[WORD_CACHE];
+  SL2ACJ matrix[WORD_CACHE];
+  int word_flags[WORD_CACHE]; // held, see context_word()
+  LeafContext* batch; // the first context of the batch, or NULL
+  size_t batch_size;
+};
+
+// Empties the caches for a new box, and leaves the context out of batches
+void reset_context(LeafContext& ctx);
+
+const SL2ACJ& context_G(LeafContext& ctx);
+
+const SL2ACJ& context_g(LeafContext& ctx);
+
+const ACJ& context_T(LeafContext& ctx, int M, int N);
+
+// The k-th power of the block, see word.h. Its flags are added to
+// *held, or raised if held is NULL.
+const SL2ACJ& context_power(LeafContext& ctx, int block, int k, int* held);
+
+SL2ACJ construct_word(LeafContext& ctx, const char* word);
+
+typedef bool (*WordTest)(LeafContext& ctx, const SL2ACJ& w);
+
+bool word_holds(LeafContext& ctx, const char* word, WordTest test);
 
 inline const double areaLB(const XParams&nearer, char* where);
 
-void verify_out_of_bounds(char* where, char bounds_code);
+void verify_out_of_bounds(LeafContext& ctx, char* where, char bounds_code);
 
 const bool not_parabolic_at_inf(const SL2ACJ& x);
 
@@ -38,20 +90,44 @@ const bool not_identity(const SL2ACJ& x);
 
 const bool large_horoball(const SL2ACJ& x, const ACJParams& p);
 
-void verify_large_horoball(char* where, char* word);
+void verify_large_horoball(LeafContext& ctx, char* where, char* word);
 
-void verify_g_length(char* where, char* word, int g_len);
+void verify_g_length(LeafContext& ctx, char* where, char* word, int g_len);
 
-void verify_variety(char* where, char* word);
+void verify_variety(LeafContext& ctx, char* where, char* word);
 
-void verify_variety_g_length(char* where, char* word, int g_len);
+void verify_variety_g_length(LeafContext& ctx, char* where, char* word, int g_len);
 
-void verify_short_parabolic(char* where, char* word);
+void verify_short_parabolic(LeafContext& ctx, char* where, char* word);
 
-void verify_bad_parabolic(char* where, char* word);
+void verify_bad_parabolic(LeafContext& ctx, char* where, char* word);
          
-void verify_bad_elliptic(char* where, char* word, char* core);
+void verify_bad_elliptic(LeafContext& ctx, char* where, char* word, char* core);
 
-void verify_no_e2_horoball(char* where);
+// The lattice cover is subdivided depth-first, each rect at most
+// E2_MAX_DEPTH times, so at most E2_MAX_DEPTH + 1 rects are pending on a
+// thread. If g_e2_pool is set, the pending rects are split off as tasks
+// of the pool every E2_TASK_RECTS rects, and the leaf fails as soon as
+// any task finds a rect it can't kill.
+#define E2_MAX_DEPTH 64
+#define E2_TASK_RECTS 256
+
+// Killers are indexed on an E2_GRID x E2_GRID grid over the initial lattice
+// cover, so a rect only tries those whose kill disk may hold its center.
+// A power of two, so rect digits map to cells exactly.
+#define E2_GRID 16
+
+// Each thread tries the words that killed its last rects first
+#define E2_RECENT 4
+
+extern Pool* g_e2_pool;
+
+// Whether every rect below root is killed by one of the words, as checked
+// by verify_no_e2_horoball() from initial_lattice_cover() with the words of
+// e2_words.h
+bool no_e2_horoball(LeafContext& ctx, char* where, const char* const* words,
+    int num_words, const Rect& root);
+
+void verify_no_e2_horoball(LeafContext& ctx, char* where);
 
 #endif // _elimination_h_
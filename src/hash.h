@@ -0,0 +1,19 @@
+#ifndef _hash_h_
+#define _hash_h_
+#include <stddef.h>
+#include <stdint.h>
+
+// FNV-1a, continuing from hash, which starts at FNV_OFFSET
+
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+inline uint64_t fnv1a(uint64_t hash, const char* data, size_t size)
+{
+  for (size_t i = 0; i < size; ++i) {
+    hash = (hash ^ (unsigned char) data[i]) * FNV_PRIME;
+  }
+  return hash;
+}
+
+#endif // _hash_h_
@@ -1,72 +1,137 @@
 #include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <unistd.h>
+#include "boxfile.h"
+#include "checkpoint.h"
 #include "elimination.h"
+#include "simd.h"
+#include "telemetry.h"
+#include "traverse.h"
+#include "tree.h"
 
-double g_max_area=3.465;
+double max_area = 3.465;
+double e2_area_min = 5.65;
+double one_over_e2_min = 0.92593;
 
-void identify(char* where, size_t depth, size_t* count_ptr)
+// Kernels checking the elimination criterion of a leaf, see walk_tree()
+
+void check_out_of_bounds(LeafContext& ctx, char* where, char* code)
 {
-    check(depth < MAX_DEPTH, where);
-    *count_ptr += 1;
-    char code[MAX_CODE_LEN];
-    fgets(code, MAX_CODE_LEN, stdin);
-    switch(code[0]) {
-        case 'X': { 
-            *count_ptr -= 1; // don't count branch nodes
-            where[depth] = '0';
-            where[depth + 1] = '\0';
-            identify(where, depth + 1, count_ptr);
-            where[depth] = '1';
-            where[depth + 1] = '\0';
-            identify(where, depth + 1, count_ptr);
-            break; }
-        case '0': 
-        case '1': 
-        case '2': 
-        case '3': 
-        case '4': 
-        case '5': 
-        case '6': {
-            verify_out_of_bounds(where, code[0]);
-            break; }
-        case 'K': { // Line has format  K(word) - killer word
-            parse_word(code);
-            verify_killed(where, code);
-            break; }
-        case 'T': { // Line has format T(word) - g-length 3 word
-            parse_word(code);
-            verify_len(where, code, 3);
-            break; }
-        case 'I': { // Line has format I(word,word) - variety intersection
-            word_pair p = get_word_pair(code);
-            verify_variety(where, p.first);
-            verify_variety(where, p.second);
-            printf("Valid variety intersection: %s and %s\n", p.first, p.second);
-            break; }
-        // We fail by default, guaranteeing completes on the tree
-        default: {
-            check(false, where);
-        }
-    }
+    verify_out_of_bounds(ctx, where, code[0]);
+}
+
+// Line has format  K(word) - killer word
+void check_large_horoball(LeafContext& ctx, char* where, char* code)
+{
+    parse_word(code);
+    verify_large_horoball(ctx, where, code);
 }
 
+// Line has format T(word) - g-length 3 word
+void check_g_length(LeafContext& ctx, char* where, char* code)
+{
+    parse_word(code);
+    verify_g_length(ctx, where, code, 3);
+}
+
+// Line has format I(word,word) - variety intersection
+void check_variety_intersection(LeafContext& ctx, char* where, char* code)
+{
+    word_pair p = get_word_pair(code);
+    verify_variety(ctx, where, p.first);
+    verify_variety(ctx, where, p.second);
+    printf("Valid variety intersection: %s and %s\n", p.first, p.second);
+}
+
+// By condition code, in the order of tree_leaf_codes. We fail on the
+// others, guaranteeing completes on the tree.
+const LeafFunc identify_kernels[16] = {
+    check_out_of_bounds, check_out_of_bounds, check_out_of_bounds,
+    check_out_of_bounds, check_out_of_bounds, check_out_of_bounds,
+    check_out_of_bounds, // 0-6
+    0, // 9
+    check_large_horoball, // K
+    0, 0, 0, 0, 0, // S V Q L E
+    check_g_length, // T
+    check_variety_intersection // I
+};
+
 int main(int argc, char**argv)
 {
-    if(argc != 1) {
-        fprintf(stderr,"Usage: %s < data\n", argv[0]);
+    const char* boxcode = "";
+    const char* checkpoint = 0;
+    bool resume = false;
+    int interval = 0;
+    const char* stats = 0;
+    const char* simd = 0;
+    static struct option long_options[] = {
+        {"checkpoint", required_argument, 0, 'c'},
+        {"resume", no_argument, 0, 'r'},
+        {"stats", required_argument, 0, 'S'},
+        {"simd", required_argument, 0, 'A'},
+        {0, 0, 0, 0}
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "b:c:rt:", long_options, 0)) != -1) {
+        if (opt == 'b') {
+            boxcode = optarg;
+        } else if (opt == 'c') {
+            checkpoint = optarg;
+        } else if (opt == 'r') {
+            resume = true;
+        } else if (opt == 't') {
+            interval = atoi(optarg);
+        } else if (opt == 'S') {
+            stats = optarg;
+        } else if (opt == 'A') {
+            simd = optarg;
+        } else {
+            optind = argc + 1;
+        }
+    }
+    if(optind < argc - 1 || strlen(boxcode) >= MAX_DEPTH
+            || strspn(boxcode, "01") != strlen(boxcode) || (resume && !checkpoint)
+            || interval < 0 || (stats && interval == 0) || !init_simd(simd)) {
+        fprintf(stderr,"Usage: %s [-b boxcode] [-c checkpoint_file [--resume]] "
+                "[-t seconds [--stats stats_file]] [--simd avx2|sse2|scalar] "
+                "[tree_location] < data\n", argv[0]);
         exit(1);
     }
+    TreeReader tree;
+    open_tree(&tree, optind == argc - 1 ? argv[optind] : NULL);
+    tree.prefetch_threads = 1;
+    tree.prefetch_bytes = PREFETCH_BYTES;
+    if (!seek_tree(&tree, boxcode)) {
+        fprintf(stderr, "Fatal: no subtree at %s\n", boxcode);
+        exit(2);
+    }
+    // A text stream must start at boxcode, e.g. rootcat -b boxcode
     char where[MAX_DEPTH];
-    size_t depth = 0;
-    where[depth] = '\0';
+    strcpy(where, boxcode);
 
     printf("Begin identify %s - {\n", where);
     initialize_roundoff();
+    if (checkpoint) {
+        init_checkpoints(checkpoint, "identify");
+    }
+    if (resume) {
+        resume_checkpoint(boxcode);
+        printf("Resuming at %s after %lu leaves\n", g_resume.next, g_resume.count);
+    }
+    if (interval) {
+        start_telemetry("identify", interval, stats, tree_leaves(&tree, boxcode),
+                resume ? g_resume.count : 0);
+    }
     size_t count = 0;
-    identify(where, depth, &count);
+    walk_tree(&tree, where, identify_kernels, 0, &count, true);
+    close_tree(&tree);
+    stop_telemetry();
     if(!roundoff_ok()){
         printf(". underflow may have occurred\n");
         exit(1);
     }
+    finish_checkpoints();
     printf("Successfully identified varieties above and verified %lu nodes\n", count);
     printf("}.\n");
     exit(0);
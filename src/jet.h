@@ -0,0 +1,222 @@
+#ifndef _jet_h_
+#define _jet_h_
+#include "ACJ.h"
+
+// Sparse jets
+//
+// The parameters of a box each vary in one coordinate only: the lattice has
+// just f0, loxodromic_sqrt just f1 and parabolic just f2, and the centers
+// and radii of the rects of verify_no_e2_horoball() are constants. A
+// Jet<S> is an ACJ whose derivatives outside the slots of S are known to be
+// zero, so the operators below skip the arithmetic ACJ.h does on them.
+//
+// ACJ.h still adds and multiplies those zeros, and that is not free of
+// rounding bookkeeping: 0 + p leaves p but adds the error of a sum to p.e.
+// The operators repeat that bookkeeping, so the value, error and size of
+// every result are bit-identical to the operator of ACJ.h, up to the sign
+// of zero parts. Operations on zeros raise no underflow or overflow, so the
+// flags agree too. Products with a full ACJ come back as ACJ.
+
+#define JET_F0 1
+#define JET_F1 2
+#define JET_F2 4
+#define JET_FULL (JET_F0 | JET_F1 | JET_F2)
+
+template <int S>
+struct Jet {
+  XComplex f;
+  XComplex d[3]; // f0, f1, f2, zero outside S
+  double e;
+  double size;
+};
+
+template <int S>
+const Jet<S> make_jet(const XComplex& f, const XComplex d[3], double e)
+{
+  Jet<S> r;
+  r.f = f;
+  double ub[3];
+  for (int k = 0; k < 3; ++k) {
+    // absUB(0) is 0, as ACJ() finds
+    r.d[k] = (S & (1 << k)) ? d[k] : XComplex(0);
+    ub[k] = (S & (1 << k)) ? absUB(d[k]) : 0;
+  }
+  r.e = e;
+  r.size = (1+2*EPS)*(ub[0]+(ub[1]+ub[2]));
+  return r;
+}
+
+// As ACJ(f, f0, f1, f2, e)
+template <int S>
+const Jet<S> make_jet(const XComplex& f, const XComplex& f0 = 0,
+    const XComplex& f1 = 0, const XComplex& f2 = 0, double e = 0)
+{
+  XComplex d[3] = { f0, f1, f2 };
+  return make_jet<S>(f, d, e);
+}
+
+inline const Jet<JET_FULL> jet(const ACJ& x)
+{
+  Jet<JET_FULL> r;
+  r.f = x.f;
+  r.d[0] = x.f0;
+  r.d[1] = x.f1;
+  r.d[2] = x.f2;
+  r.e = x.e;
+  r.size = x.size;
+  return r;
+}
+
+template <int S>
+const ACJ acj(const Jet<S>& x)
+{
+  return ACJ(x.f, x.d[0], x.d[1], x.d[2], x.e);
+}
+
+template <int S>
+inline const double absUB(const Jet<S>& x)
+{
+  return (1+2*EPS)*(absUB(x.f)+(x.size+x.e));
+}
+
+template <int S>
+inline const double absLB(const Jet<S>& x)
+{
+  double v = (1-EPS)*(absLB(x.f)-(1+EPS)*(x.size+x.e));
+  return (v > 0) ? v : 0;
+}
+
+// p + 0 and 0 + p of AComplex, see Complex.inline
+inline const AComplex plus_zero(const AComplex& p)
+{
+  return AComplex(p.z.re, p.z.im,
+      (1+2*EPS)*(HALFEPS*(fabs(p.z.re)+fabs(p.z.im))+p.e));
+}
+
+// 0 - p
+inline const AComplex zero_minus(const AComplex& p)
+{
+  return AComplex(-p.z.re, -p.z.im,
+      (1+2*EPS)*(HALFEPS*(fabs(p.z.re)+fabs(p.z.im))+p.e));
+}
+
+template <int X, int Y>
+const Jet<X | Y> operator*(const Jet<X>& x, const Jet<Y>& y)
+{
+  double xdist = x.size;
+  double ydist = y.size;
+  double ax = absUB(x.f), ay = absUB(y.f);
+  AComplex r_f = x.f*y.f;
+  AComplex r_d[3] = { AComplex(0, 0, 0), AComplex(0, 0, 0), AComplex(0, 0, 0) };
+  for (int k = 0; k < 3; ++k) {
+    bool in_x = X & (1 << k);
+    bool in_y = Y & (1 << k);
+    if (in_x && in_y) {
+      r_d[k] = x.f*y.d[k]+x.d[k]*y.f;
+    } else if (in_y) {
+      r_d[k] = plus_zero(x.f*y.d[k]);
+    } else if (in_x) {
+      r_d[k] = plus_zero(x.d[k]*y.f);
+    }
+  }
+  double A = (xdist+x.e)*(ydist+y.e);
+  double B = ax*y.e+ay*x.e;
+  double C = (r_f.e+r_d[0].e)+(r_d[1].e+r_d[2].e);
+  double r_error = (1+3*EPS)*(A+(B+C));
+  XComplex d[3] = { r_d[0].z, r_d[1].z, r_d[2].z };
+  return make_jet<X | Y>(r_f.z, d, r_error);
+}
+
+// Slots empty in both are 0 / den. ACJ.h evaluates that too, but it only
+// differs from 0 when den underflows, which roundoff_ok() catches.
+template <int X, int Y>
+const Jet<X | Y> operator/(const Jet<X>& x, const Jet<Y>& y)
+{
+  static_assert((X | Y) != 0, "divide constants with ACJ.h");
+  double xdist = x.size;
+  double ydist = y.size;
+  double ax = absUB(x.f), ay = absLB(y.f);
+  double D = ay-(1+EPS)*(y.e+ydist);
+  if (!(D > 0)) {
+    return make_jet<X | Y>(0, 0, 0, 0, infinity());
+  }
+  AComplex den = (y.f*y.f);
+  AComplex r_f = x.f/y.f;
+  AComplex r_d[3] = { AComplex(0, 0, 0), AComplex(0, 0, 0), AComplex(0, 0, 0) };
+  for (int k = 0; k < 3; ++k) {
+    bool in_x = X & (1 << k);
+    bool in_y = Y & (1 << k);
+    if (in_x && in_y) {
+      r_d[k] = (x.d[k]*y.f-x.f*y.d[k])/den;
+    } else if (in_y) {
+      r_d[k] = zero_minus(x.f*y.d[k])/den;
+    } else if (in_x) {
+      r_d[k] = plus_zero(x.d[k]*y.f)/den;
+    }
+  }
+  double A = (ax+(xdist+x.e))/D;
+  double B = (ax/ay+xdist/ay)+(ydist*ax)/(ay*ay);
+  double C = (r_f.e+r_d[0].e)+(r_d[1].e+r_d[2].e);
+  double r_error = (1+3*EPS)*(((1+3*EPS)*A-(1-3*EPS)*B)+C);
+  XComplex d[3] = { r_d[0].z, r_d[1].z, r_d[2].z };
+  return make_jet<X | Y>(r_f.z, d, r_error);
+}
+
+template <int S>
+const Jet<S> operator*(const Jet<S>& x, double y)
+{
+  AComplex r_f = x.f*y;
+  AComplex r_d[3] = { AComplex(0, 0, 0), AComplex(0, 0, 0), AComplex(0, 0, 0) };
+  for (int k = 0; k < 3; ++k) {
+    if (S & (1 << k)) {
+      r_d[k] = x.d[k]*y;
+    }
+  }
+  double r_error = (1+3*EPS)*(
+      (x.e*fabs(y))
+      +((r_f.e+r_d[0].e)+(r_d[1].e+r_d[2].e))
+      );
+  XComplex d[3] = { r_d[0].z, r_d[1].z, r_d[2].z };
+  return make_jet<S>(r_f.z, d, r_error);
+}
+
+// The derivatives are unchanged, and so is the size
+template <int S>
+const Jet<S> operator+(const Jet<S>& x, double y)
+{
+  AComplex r_f = x.f+y;
+  Jet<S> r(x);
+  r.f = r_f.z;
+  r.e = (1+EPS)*(x.e+r_f.e);
+  return r;
+}
+
+template <int S>
+const Jet<S> operator-(const Jet<S>& x, double y)
+{
+  AComplex r_f = x.f-y;
+  Jet<S> r(x);
+  r.f = r_f.z;
+  r.e = (1+EPS)*(x.e+r_f.e);
+  return r;
+}
+
+template <int S>
+const ACJ operator*(const ACJ& x, const Jet<S>& y)
+{
+  return acj(jet(x)*y);
+}
+
+template <int S>
+const ACJ operator/(const ACJ& x, const Jet<S>& y)
+{
+  return acj(jet(x)/y);
+}
+
+template <int S>
+const ACJ operator/(const Jet<S>& x, const ACJ& y)
+{
+  return acj(x/jet(y));
+}
+
+#endif // _jet_h_
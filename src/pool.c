@@ -0,0 +1,260 @@
+#include <fenv.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <deque>
+
+#include "pool.h"
+
+// Flags that matter for rigor; inexact is raised by nearly every operation
+#define POOL_FP_FLAGS (FE_ALL_EXCEPT & ~FE_INEXACT)
+
+typedef struct {
+  TaskFunc func;
+  void* arg;
+  TaskGroup* group;
+} Task;
+
+typedef struct {
+  pthread_mutex_t lock;
+  std::deque<Task> tasks;
+} Worker;
+
+struct Pool {
+  int num_workers;
+  Worker* workers;
+  pthread_t* threads;
+  pthread_mutex_t lock;
+  pthread_cond_t work;
+  pthread_cond_t done;
+  size_t pending; // submitted and not yet finished
+  size_t queued;  // waiting in a deque
+  size_t max_pending;
+  size_t next;
+  size_t events; // submissions and completions, for wait_group()
+  bool stop;
+  int fp_flags;
+};
+
+typedef struct {
+  Pool* pool;
+  int id;
+} WorkerArg;
+
+// Index of the worker running on this thread, or -1 outside the pool
+__thread int t_worker = -1;
+
+bool pop_task(Pool* pool, int id, Task* task)
+{
+  for (int i = 0; i < pool->num_workers; ++i) {
+    Worker* w = &pool->workers[(id + i) % pool->num_workers];
+    pthread_mutex_lock(&w->lock);
+    bool found = !w->tasks.empty();
+    if (found && i == 0) {
+      *task = w->tasks.back();
+      w->tasks.pop_back();
+    } else if (found) {
+      *task = w->tasks.front(); // steal the oldest task
+      w->tasks.pop_front();
+    }
+    pthread_mutex_unlock(&w->lock);
+    if (found) {
+      pthread_mutex_lock(&pool->lock);
+      --pool->queued;
+      pthread_mutex_unlock(&pool->lock);
+      return true;
+    }
+  }
+  return false;
+}
+
+// Takes a queued task of group, the newest of this worker's first
+bool pop_group_task(Pool* pool, int id, TaskGroup* group, Task* task)
+{
+  for (int i = 0; i < pool->num_workers; ++i) {
+    Worker* w = &pool->workers[(id + i) % pool->num_workers];
+    pthread_mutex_lock(&w->lock);
+    bool found = false;
+    for (size_t j = w->tasks.size(); j > 0 && !found; --j) {
+      if (w->tasks[j-1].group == group) {
+        *task = w->tasks[j-1];
+        w->tasks.erase(w->tasks.begin() + (j-1));
+        found = true;
+      }
+    }
+    pthread_mutex_unlock(&w->lock);
+    if (found) {
+      pthread_mutex_lock(&pool->lock);
+      --pool->queued;
+      pthread_mutex_unlock(&pool->lock);
+      return true;
+    }
+  }
+  return false;
+}
+
+void run_task(Pool* pool, const Task& task)
+{
+  task.func(task.arg);
+  pthread_mutex_lock(&pool->lock);
+  --pool->pending;
+  ++pool->events;
+  if (task.group) {
+    task.group->fp_flags |= fetestexcept(POOL_FP_FLAGS);
+    --task.group->pending;
+  }
+  pthread_cond_broadcast(&pool->done);
+  pthread_mutex_unlock(&pool->lock);
+}
+
+void* run_worker(void* arg)
+{
+  Pool* pool = ((WorkerArg*) arg)->pool;
+  int id = ((WorkerArg*) arg)->id;
+  free(arg);
+  t_worker = id;
+  while (true) {
+    Task task;
+    if (pop_task(pool, id, &task)) {
+      run_task(pool, task);
+      continue;
+    }
+    pthread_mutex_lock(&pool->lock);
+    while (pool->queued == 0 && !pool->stop) {
+      pthread_cond_wait(&pool->work, &pool->lock);
+    }
+    bool stop = pool->stop && pool->queued == 0;
+    pthread_mutex_unlock(&pool->lock);
+    if (stop) {
+      break;
+    }
+  }
+  pthread_mutex_lock(&pool->lock);
+  pool->fp_flags |= fetestexcept(POOL_FP_FLAGS);
+  pthread_mutex_unlock(&pool->lock);
+  return 0;
+}
+
+Pool* create_pool(int threads, size_t max_pending)
+{
+  Pool* pool = new Pool();
+  pool->num_workers = threads;
+  pool->workers = new Worker[threads];
+  pool->threads = new pthread_t[threads];
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->work, NULL);
+  pthread_cond_init(&pool->done, NULL);
+  pool->pending = 0;
+  pool->queued = 0;
+  pool->max_pending = max_pending;
+  pool->next = 0;
+  pool->events = 0;
+  pool->stop = false;
+  pool->fp_flags = 0;
+  for (int i = 0; i < threads; ++i) {
+    pthread_mutex_init(&pool->workers[i].lock, NULL);
+  }
+  for (int i = 0; i < threads; ++i) {
+    WorkerArg* arg = (WorkerArg*) malloc(sizeof(WorkerArg));
+    arg->pool = pool;
+    arg->id = i;
+    if (pthread_create(&pool->threads[i], NULL, run_worker, arg) != 0) {
+      fprintf(stderr, "Fatal: failed to start worker thread\n");
+      exit(2);
+    }
+  }
+  return pool;
+}
+
+void queue_task(Pool* pool, const Task& task)
+{
+  pthread_mutex_lock(&pool->lock);
+  int id = t_worker;
+  if (id < 0) {
+    while (!task.group && pool->pending >= pool->max_pending) {
+      pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    id = pool->next++ % pool->num_workers;
+  }
+  Worker* w = &pool->workers[id];
+  pthread_mutex_lock(&w->lock);
+  w->tasks.push_back(task);
+  pthread_mutex_unlock(&w->lock);
+  ++pool->pending;
+  ++pool->queued;
+  ++pool->events;
+  if (task.group) {
+    ++task.group->pending;
+    // Threads in wait_group() sleep on done
+    pthread_cond_broadcast(&pool->done);
+  }
+  pthread_cond_signal(&pool->work);
+  pthread_mutex_unlock(&pool->lock);
+}
+
+void submit_task(Pool* pool, TaskFunc func, void* arg)
+{
+  Task task = { func, arg, 0 };
+  queue_task(pool, task);
+}
+
+void submit_group_task(Pool* pool, TaskGroup* group, TaskFunc func, void* arg)
+{
+  Task task = { func, arg, group };
+  queue_task(pool, task);
+}
+
+void wait_group(Pool* pool, TaskGroup* group)
+{
+  int id = t_worker < 0 ? 0 : t_worker;
+  while (true) {
+    pthread_mutex_lock(&pool->lock);
+    size_t events = pool->events;
+    bool done = group->pending == 0;
+    pthread_mutex_unlock(&pool->lock);
+    if (done) {
+      break;
+    }
+    Task task;
+    if (pop_group_task(pool, id, group, &task)) {
+      run_task(pool, task);
+      continue;
+    }
+    // The rest of the group is running elsewhere
+    pthread_mutex_lock(&pool->lock);
+    while (pool->events == events && group->pending > 0) {
+      pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+  }
+  if (group->fp_flags) {
+    feraiseexcept(group->fp_flags);
+  }
+}
+
+void wait_pool(Pool* pool)
+{
+  pthread_mutex_lock(&pool->lock);
+  while (pool->pending > 0) {
+    pthread_cond_wait(&pool->done, &pool->lock);
+  }
+  pthread_mutex_unlock(&pool->lock);
+}
+
+void destroy_pool(Pool* pool)
+{
+  wait_pool(pool);
+  pthread_mutex_lock(&pool->lock);
+  pool->stop = true;
+  pthread_cond_broadcast(&pool->work);
+  pthread_mutex_unlock(&pool->lock);
+  for (int i = 0; i < pool->num_workers; ++i) {
+    pthread_join(pool->threads[i], NULL);
+  }
+  if (pool->fp_flags) {
+    feraiseexcept(pool->fp_flags);
+  }
+  delete[] pool->workers;
+  delete[] pool->threads;
+  delete pool;
+}
@@ -0,0 +1,40 @@
+#ifndef _pool_h_
+#define _pool_h_
+#include <stddef.h>
+
+// Work-stealing task pool. Each worker runs tasks from the back of its own
+// deque and steals from the front of the others when it runs dry. Floating
+// point exception flags are per thread, so each worker records the flags
+// it raised and destroy_pool() raises their union in the calling thread,
+// where roundoff_ok() sees them as usual.
+
+typedef void (*TaskFunc)(void* arg);
+
+typedef struct Pool Pool;
+
+// At most max_pending tasks submitted from outside the pool may be
+// unfinished at once; submit_task() blocks until there is room.
+Pool* create_pool(int threads, size_t max_pending);
+
+void submit_task(Pool* pool, TaskFunc func, void* arg);
+
+// Blocks until every submitted task has finished
+void wait_pool(Pool* pool);
+
+// The tasks of a group can be waited for on their own, also by a task.
+// The waiting thread runs queued tasks of the group meanwhile, and never
+// other tasks, so it keeps the state of the task it is in. Group tasks
+// never block on max_pending, and may submit more tasks to their group.
+// The flags the tasks raised are raised in the waiting thread.
+typedef struct {
+  size_t pending; // guarded by the lock of the pool
+  int fp_flags;
+} TaskGroup;
+
+void submit_group_task(Pool* pool, TaskGroup* group, TaskFunc func, void* arg);
+
+void wait_group(Pool* pool, TaskGroup* group);
+
+void destroy_pool(Pool* pool);
+
+#endif // _pool_h_
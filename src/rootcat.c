@@ -2,46 +2,148 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/stat.h>
+#include <unistd.h>
+
+#include "boxfile.h"
 
-#define MAX_DEPTH 512
 #define MAX_BUF 1024
+#define RELAY_BUF (1 << 20)
+
+// With -x depth, rootcat prints the subtree index described in boxfile.h.
+// With -b boxcode, rootcat reads tree_location/tree.idx and prints only
+// the subtree at boxcode, starting from the deepest indexed ancestor.
+
+int g_index_depth = -1;
+IndexEntry* g_index = 0;
+size_t g_index_size = 0;
+long g_index_open[MAX_BOXCODE_LEN];
+size_t g_leaves = 0;
+
+const char* g_target = "";
+bool g_emitted = false;
+bool g_done = false;
+
+void close_index_entries(size_t depth)
+{
+  for (int d = depth; d <= g_index_depth; ++d) {
+    if (g_index_open[d] >= 0) {
+      IndexEntry* e = &g_index[g_index_open[d]];
+      e->leaves = g_leaves - e->start_leaves;
+      g_index_open[d] = -1;
+    }
+  }
+}
 
-char* g_tree_location;
+void index_node(const char* boxcode, const char* file, size_t offset)
+{
+  size_t depth = strlen(boxcode);
+  close_index_entries(depth);
+  if ((int) depth > g_index_depth) {
+    return;
+  }
+  if ((g_index_size & (g_index_size - 1)) == 0) {
+    g_index = (IndexEntry*) realloc(g_index,
+        (g_index_size ? 2 * g_index_size : 1) * sizeof(IndexEntry));
+  }
+  IndexEntry* e = &g_index[g_index_size];
+  e->boxcode = strdup(boxcode);
+  e->file = strdup(file);
+  e->offset = offset;
+  e->start_leaves = g_leaves;
+  e->leaves = 0;
+  g_index_open[depth] = g_index_size++;
+}
 
-FILE* open_box(char* boxcode)
+void write_index()
 {
-  char file_boxcode[MAX_DEPTH];
-  char file_name[MAX_BUF];
-  // Open the root file if empty
-  if (strlen(boxcode) == 0) {
-    strcpy(file_boxcode, "root");
-  } else {
-    strcpy(file_boxcode, boxcode);
-  }
-  // Look for a out file
-  sprintf(file_name, "%s/%s.out", g_tree_location, file_boxcode);
-  struct stat sb;
-  if (0 == stat(file_name, &sb)) {
-    return fopen(file_name, "r");
-  }
-  // Look for a gzipped out file
-  sprintf(file_name, "%s/%s.out.tar.gz", g_tree_location, file_boxcode);
-  if (0 == stat(file_name, &sb)) {
-    char command_buf[MAX_BUF];
-    sprintf(command_buf, "tar -xOzf %s", file_name);
-    return popen(command_buf, "r");
-  }
-  return 0;
+  close_index_entries(0);
+  printf("# rootcat index depth %d\n", g_index_depth);
+  for (size_t i = 0; i < g_index_size; ++i) {
+    IndexEntry* e = &g_index[i];
+    printf("%s %s %lu %lu\n", strlen(e->boxcode) ? e->boxcode : "root",
+        strlen(e->file) ? e->file : "root", e->offset, e->leaves);
+  }
 }
 
-bool process_tree(FILE* fp, char* boxcode)
+bool in_target(const char* boxcode)
 {
+  return strncmp(boxcode, g_target, strlen(g_target)) == 0;
+}
+
+bool process_tree(FILE* fp, char* boxcode, const char* file, size_t offset);
+
+// Copies a subtree to stdout in whole blocks. Only the first character of
+// each line is looked at, to follow the structure and find hole files.
+bool relay_tree(FILE* fp, char* boxcode)
+{
+  bool success = false;
+  size_t box_depth = strlen(boxcode);
+  size_t depth = 0;
+  char* buf = (char*) malloc(RELAY_BUF);
+  size_t len = 0; // bytes in buf
+  size_t pos = 0; // start of the current line
+  size_t run = 0; // start of the bytes not yet written
+  bool eof = false;
+  g_emitted = true;
+  while (!success) {
+    char* nl = (char*) memchr(buf + pos, '\n', len - pos);
+    size_t end = nl ? nl - buf + 1 : len;
+    if (!nl && !(eof && pos < len)) {
+      if (eof) {
+        break;
+      }
+      fwrite(buf + run, 1, pos - run, stdout);
+      memmove(buf, buf + pos, len - pos);
+      len -= pos;
+      pos = run = 0;
+      if (len == RELAY_BUF) {
+        fprintf(stderr, "Fatal: line too long at %s\n", boxcode);
+        exit(4);
+      }
+      size_t n = fread(buf + len, 1, RELAY_BUF - len, fp);
+      eof = n == 0;
+      len += n;
+      continue;
+    }
+    // Open HOLE file
+    if (buf[pos] == 'H') {
+      if (depth == 0) {
+        fprintf(stderr, "Fatal: recursive hole file at %s\n", boxcode);
+        exit(4);
+      }
+      fwrite(buf + run, 1, pos - run, stdout);
+      run = end;
+      FILE* fp_hole = open_box(boxcode);
+      if (!fp_hole) {
+        fprintf(stderr, "Fatal: failed to open hole file at %s\n", boxcode);
+        exit(2);
+      }
+      bool hole_success = relay_tree(fp_hole, boxcode);
+      fclose(fp_hole);
+      if (!hole_success) {
+        fprintf(stderr, "Fatal: hole file incomplete at %s\n", boxcode);
+        exit(5);
+      }
+    }
+    success = advance_boxcode(boxcode, box_depth, &depth, buf[pos]);
+    pos = end;
+  }
+  fwrite(buf + run, 1, pos - run, stdout);
+  free(buf);
+  return success;
+}
+
+bool process_tree(FILE* fp, char* boxcode, const char* file, size_t offset)
+{
+  // Nothing to index or filter, so the lines can be passed on verbatim
+  if (g_index_depth < 0 && in_target(boxcode)) {
+    return relay_tree(fp, boxcode);
+  }
   bool success = true;
   size_t box_depth = strlen(boxcode);
   char buf[MAX_BUF];
   size_t depth = 0;
-  while (fgets(buf, sizeof(buf), fp)) {
+  while (!g_done && fgets(buf, sizeof(buf), fp)) {
     // Open HOLE file
     if (buf[0] == 'H') {
       if (depth == 0) {
@@ -53,58 +155,106 @@ bool process_tree(FILE* fp, char* boxcode)
         fprintf(stderr, "Fatal: failed to open hole file at %s\n", boxcode);
         exit(2);
       }
-      success = process_tree(fp_hole, boxcode);
+      char hole_file[MAX_BOXCODE_LEN];
+      strcpy(hole_file, boxcode);
+      success = process_tree(fp_hole, boxcode, hole_file, 0);
       fclose(fp_hole);
       if (!success) {
         fprintf(stderr, "Fatal: hole file incomplete at %s\n", boxcode);
         exit(5);
       }
-    } else {
-      fprintf(stdout, "%s", buf); 
-    }
-    if (buf[0] == 'X') {
-      boxcode[box_depth + depth] = '0'; // descend via left branch
-      ++depth;
-      boxcode[box_depth + depth] = '\0';
-    } else {
-      // Go up as many nodes as necessary
-      for (; depth > 0 && boxcode[box_depth + depth - 1] == '1'; --depth) {}
-      if (depth > 0) {
-        boxcode[box_depth + depth - 1] = '1'; // jump from left to right node
-        boxcode[box_depth + depth] = '\0'; // truncate to keep box current
-      } else {
-        boxcode[box_depth] = '\0'; // truncate to keep box current
+      if (g_done) {
         return true;
       }
+    } else {
+      if (g_index_depth >= 0) {
+        index_node(boxcode, file, offset);
+      } else if (in_target(boxcode)) {
+        fprintf(stdout, "%s", buf); 
+        g_emitted = true;
+      }
+      if (buf[0] != 'X') {
+        ++g_leaves;
+      }
     }
+    offset += strlen(buf);
+    if (advance_boxcode(boxcode, box_depth, &depth, buf[0])) {
+      return true;
+    }
+    g_done = g_emitted && !in_target(boxcode);
   }
-  return false; 
+  return g_done; 
 }
 
 int main(int argc, char** argv)
 {
-  if (argc != 2) {
-    fprintf(stderr, "Usage: rootcat tree_location\n");
+  int threads = sysconf(_SC_NPROCESSORS_ONLN) / 2;
+  size_t max_bytes = PREFETCH_BYTES;
+  const char* target = 0;
+  int opt;
+  while ((opt = getopt(argc, argv, "j:m:x:b:")) != -1) {
+    if (opt == 'j') {
+      threads = atoi(optarg);
+    } else if (opt == 'm') {
+      max_bytes = (size_t) atol(optarg) << 20;
+    } else if (opt == 'x') {
+      g_index_depth = atoi(optarg);
+    } else if (opt == 'b') {
+      target = optarg;
+    } else {
+      optind = argc + 1;
+    }
+  }
+  if (optind != argc - 1 || g_index_depth >= MAX_BOXCODE_LEN
+      || (target && (g_index_depth >= 0 || strlen(target) >= MAX_BOXCODE_LEN
+                     || strspn(target, "01") != strlen(target)))) {
+    fprintf(stderr, "Usage: rootcat [-j prefetch_threads] [-m prefetch_megabytes] "
+        "[-x index_depth | -b boxcode] tree_location\n");
     exit(1);
   }
+  for (int d = 0; d < MAX_BOXCODE_LEN; ++d) {
+    g_index_open[d] = -1;
+  }
+
+  const char* location = argv[optind];
+  open_box_files(location);
+  setvbuf(stdout, NULL, _IOFBF, STREAM_BUF);
 
-  g_tree_location = argv[1];
+  // Start from the deepest indexed ancestor of the target, or the root
+  IndexEntry start;
+  memset(&start, 0, sizeof(start));
+  if (!target || !find_index_entry(target, &start)) {
+    start.boxcode = strdup("");
+    start.file = strdup("");
+  }
+  if (target) {
+    g_target = target;
+  }
+  start_prefetch(threads, max_bytes, start.file);
 
-  char full_boxcode[MAX_DEPTH];
-  full_boxcode[0] = '\0'; // root
+  char full_boxcode[MAX_BOXCODE_LEN];
+  strcpy(full_boxcode, start.boxcode);
 
-  FILE* fp = open_box(full_boxcode);
+  FILE* fp = open_box(start.file);
   if (!fp) {
     fprintf(stderr, "Fatal: failed to open root file\n");
     exit(2);
   }
-  bool success = process_tree(fp, full_boxcode);
+  skip_to(fp, start.offset);
+  bool success = process_tree(fp, full_boxcode, start.file, start.offset);
   fclose(fp);
 
   if (!success) {
     fprintf(stderr, "Fatal: incomplete tree\n");
     exit(3);
   }
+  if (target && !g_emitted) {
+    fprintf(stderr, "Fatal: no subtree at %s\n", target);
+    exit(3);
+  }
+  if (g_index_depth >= 0) {
+    write_index();
+  }
 
   exit(0); 
 }
@@ -0,0 +1,111 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hash.h"
+#include "shard.h"
+#include "tree.h"
+
+typedef struct {
+  char* boxcode;
+  size_t leaves;
+  uint64_t hash;
+} Unit;
+
+int g_shard_index = 0;
+int g_shard_count = 1;
+size_t g_shard_depth = 0;
+
+Unit* g_units = 0;
+size_t g_num_units = 0;
+size_t g_conditions[16];
+
+bool init_shard(const char* spec, size_t depth)
+{
+  char end;
+  if (sscanf(spec, "%d/%d%c", &g_shard_index, &g_shard_count, &end) != 2
+      || g_shard_count < 1 || g_shard_index < 0
+      || g_shard_index >= g_shard_count || depth > MAX_SHARD_DEPTH) {
+    return false;
+  }
+  g_shard_depth = depth;
+  return true;
+}
+
+bool in_shard(const char* where)
+{
+  size_t len = strlen(where);
+  uint64_t value = 0;
+  for (size_t i = 0; i < g_shard_depth; ++i) {
+    value = 2 * value + (i < len && where[i] == '1'); // padded with zeros
+  }
+  return value % g_shard_count == (uint64_t) g_shard_index;
+}
+
+void record_unit(const char* where, const char* lines, size_t size)
+{
+  if ((g_num_units & (g_num_units - 1)) == 0) {
+    g_units = (Unit*) realloc(g_units,
+        (g_num_units ? 2 * g_num_units : 1) * sizeof(Unit));
+  }
+  Unit* u = &g_units[g_num_units++];
+  u->boxcode = strdup(where);
+  u->leaves = 0;
+  u->hash = fnv1a(FNV_OFFSET, lines, size);
+  for (const char* line = lines; line < lines + size; ) {
+    int index = leaf_code_index(line[0]);
+    if (line[0] != 'X' && index >= 0) {
+      ++u->leaves;
+      ++g_conditions[index];
+    }
+    const char* nl = (const char*) memchr(line, '\n', lines + size - line);
+    line = nl ? nl + 1 : lines + size;
+  }
+}
+
+// Writes a line to the record and adds it to the checksum
+void record_line(FILE* fp, uint64_t* checksum, const char* line)
+{
+  fputs(line, fp);
+  *checksum = fnv1a(*checksum, line, strlen(line));
+}
+
+void write_shard_record(const char* path, const char* program,
+    const char* root, bool roundoff)
+{
+  FILE* fp = fopen(path, "w");
+  if (!fp) {
+    fprintf(stderr, "Fatal: failed to write shard record %s\n", path);
+    exit(2);
+  }
+  uint64_t checksum = FNV_OFFSET;
+  char line[1024];
+  sprintf(line, "# %s shard record\n", program);
+  record_line(fp, &checksum, line);
+  sprintf(line, "shard %d %d %lu %s\n", g_shard_index, g_shard_count,
+      g_shard_depth, strlen(root) ? root : "root");
+  record_line(fp, &checksum, line);
+  size_t leaves = 0;
+  for (size_t i = 0; i < g_num_units; ++i) {
+    Unit* u = &g_units[i];
+    sprintf(line, "unit %s %lu %016lx\n", strlen(u->boxcode) ? u->boxcode : "root",
+        u->leaves, u->hash);
+    record_line(fp, &checksum, line);
+    leaves += u->leaves;
+  }
+  strcpy(line, "conditions");
+  for (int i = 0; i < 16; ++i) {
+    sprintf(line + strlen(line), " %c:%lu", tree_leaf_codes[i], g_conditions[i]);
+  }
+  strcat(line, "\n");
+  record_line(fp, &checksum, line);
+  sprintf(line, "leaves %lu\n", leaves);
+  record_line(fp, &checksum, line);
+  sprintf(line, "roundoff %s\n", roundoff ? "ok" : "failed");
+  record_line(fp, &checksum, line);
+  fprintf(fp, "checksum %016lx\n", checksum);
+  if (fclose(fp) != 0) {
+    fprintf(stderr, "Fatal: failed to write shard record %s\n", path);
+    exit(2);
+  }
+}
@@ -0,0 +1,40 @@
+#ifndef _shard_h_
+#define _shard_h_
+#include <stddef.h>
+#include <stdint.h>
+
+// Shards of a verify run
+//
+// The tree is cut into units: the nodes at depth shard_depth, and the
+// leaves above that depth. A unit belongs to shard index/count if its
+// boxcode, padded with zeros to shard_depth bits and read as a binary
+// number, is index modulo count. Each shard writes a record,
+//    # verify shard record
+//    shard index count depth root
+//    unit boxcode leaves hash
+//    ...
+//    conditions c:n c:n ...
+//    leaves total
+//    roundoff ok|failed
+//    checksum hash
+// where root is the boxcode the run started from, each unit lists its
+// leaves and an FNV-1a hash of its lines, conditions counts the leaves of
+// each condition code and checksum is the FNV-1a hash of every line before
+// it. An empty boxcode is written as "root". shardmerge checks that a set
+// of records covers the tree exactly once and, given the tree, that the
+// leaves and hash of each unit match it.
+
+#define MAX_SHARD_DEPTH 62
+
+// Parses "index/count" for shards of units at depth
+bool init_shard(const char* spec, size_t depth);
+
+bool in_shard(const char* where);
+
+// Records a unit of this shard given its depth-first lines
+void record_unit(const char* where, const char* lines, size_t size);
+
+void write_shard_record(const char* path, const char* program,
+    const char* root, bool roundoff);
+
+#endif // _shard_h_
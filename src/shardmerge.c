@@ -0,0 +1,289 @@
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+
+#include "boxfile.h"
+#include "hash.h"
+#include "shard.h"
+#include "tree.h"
+
+// Checks that a set of shard records, see shard.h, come from one run that
+// verified every unit of the tree exactly once, and totals their counts.
+// Given the tree, also checks the leaves and hash of each unit against it,
+// so every shard is known to have verified the same tree.
+
+#define MAX_LINE 1024
+
+typedef struct {
+  uint64_t start;
+  uint64_t end;
+  const char* boxcode;
+  size_t leaves;
+  uint64_t hash;
+} Interval;
+
+char g_program[64] = "";
+int g_count = -1;
+size_t g_depth = 0;
+char g_root[MAX_LINE] = "";
+
+std::vector<Interval> g_intervals;
+std::vector<bool> g_seen;
+size_t g_conditions[16];
+size_t g_leaves = 0;
+
+void bad_record(const char* path, const char* reason)
+{
+  fprintf(stderr, "Fatal: shard record %s is invalid (%s)\n", path, reason);
+  exit(7);
+}
+
+// The units below boxcode, at depth g_depth, as a range of integers
+Interval unit_interval(const char* boxcode)
+{
+  size_t len = strlen(boxcode);
+  uint64_t value = 0;
+  for (size_t i = 0; i < g_depth; ++i) {
+    value = 2 * value + (i < len && boxcode[i] == '1');
+  }
+  Interval interval = { value, value + (1ULL << (g_depth - len)), boxcode, 0, 0 };
+  return interval;
+}
+
+bool valid_boxcode(const char* boxcode, size_t max_len)
+{
+  return strlen(boxcode) <= max_len && strspn(boxcode, "01") == strlen(boxcode);
+}
+
+void read_record(const char* path)
+{
+  FILE* fp = fopen(path, "r");
+  if (!fp) {
+    fprintf(stderr, "Fatal: failed to open shard record %s\n", path);
+    exit(2);
+  }
+  uint64_t checksum = FNV_OFFSET;
+  char line[MAX_LINE];
+  int index = -1;
+  size_t leaves = 0;
+  size_t unit_leaves = 0;
+  bool roundoff = false;
+  bool closed = false;
+  while (fgets(line, sizeof(line), fp)) {
+    char word[MAX_LINE];
+    char boxcode[MAX_LINE];
+    uint64_t hash;
+    size_t n;
+    if (closed) {
+      bad_record(path, "text after checksum");
+    } else if (sscanf(line, "checksum %lx", &hash) == 1) {
+      if (hash != checksum) {
+        bad_record(path, "checksum mismatch");
+      }
+      closed = true;
+      continue;
+    }
+    checksum = fnv1a(checksum, line, strlen(line));
+    if (line[0] == '#') {
+      char program[64];
+      if (sscanf(line, "# %63s shard record", program) != 1
+          || (g_program[0] && strcmp(program, g_program) != 0)) {
+        bad_record(path, "wrong program");
+      }
+      strcpy(g_program, program);
+    } else if (sscanf(line, "shard %d %d %lu %s", &index, &g_count, &n, boxcode) == 4) {
+      if (strcmp(boxcode, "root") == 0) {
+        boxcode[0] = '\0';
+      }
+      if (g_seen.empty()) {
+        g_seen.resize(g_count);
+        g_depth = n;
+        strcpy(g_root, boxcode);
+      }
+      if (g_count != (int) g_seen.size() || g_depth != n || strcmp(boxcode, g_root) != 0
+          || g_depth > MAX_SHARD_DEPTH || !valid_boxcode(g_root, g_depth)) {
+        bad_record(path, "shard layout differs from the other records");
+      }
+      if (index < 0 || index >= g_count || g_seen[index]) {
+        bad_record(path, "shard index repeated or out of range");
+      }
+      g_seen[index] = true;
+    } else if (sscanf(line, "unit %s %lu %lx", boxcode, &n, &hash) == 3) {
+      if (strcmp(boxcode, "root") == 0) {
+        boxcode[0] = '\0';
+      }
+      if (index < 0 || !valid_boxcode(boxcode, g_depth)
+          || strncmp(boxcode, g_root, strlen(g_root)) != 0) {
+        bad_record(path, "unit outside the tree");
+      }
+      Interval interval = unit_interval(strdup(boxcode));
+      if (interval.start % g_count != (uint64_t) index) {
+        bad_record(path, "unit of another shard");
+      }
+      interval.leaves = n;
+      interval.hash = hash;
+      g_intervals.push_back(interval);
+      unit_leaves += n;
+    } else if (strncmp(line, "conditions ", 11) == 0) {
+      char* token = strtok(line + 10, " \n");
+      for (; token; token = strtok(NULL, " \n")) {
+        char code;
+        if (sscanf(token, "%c:%lu", &code, &n) != 2 || leaf_code_index(code) < 0) {
+          bad_record(path, "bad condition count");
+        }
+        g_conditions[leaf_code_index(code)] += n;
+      }
+    } else if (sscanf(line, "leaves %lu", &leaves) == 1) {
+      continue;
+    } else if (sscanf(line, "roundoff %s", word) == 1) {
+      roundoff = strcmp(word, "ok") == 0;
+    } else {
+      bad_record(path, "unknown line");
+    }
+  }
+  fclose(fp);
+  if (!closed || index < 0) {
+    bad_record(path, "truncated");
+  }
+  if (leaves != unit_leaves) {
+    bad_record(path, "leaf count differs from its units");
+  }
+  if (!roundoff) {
+    fprintf(stderr, "Fatal: shard %d of %s reports roundoff error\n", index, path);
+    exit(1);
+  }
+  g_leaves += leaves;
+}
+
+bool interval_less(const Interval& a, const Interval& b)
+{
+  return a.start < b.start;
+}
+
+void unit_differs(const char* where, const char* reason)
+{
+  fprintf(stderr, "Fatal: unit %s differs from the tree (%s)\n",
+      strlen(where) ? where : "root", reason);
+  exit(3);
+}
+
+// Walks the tree below where as verify's dispatch() cuts it into units,
+// hashing the lines of each as record_unit() does, and compares each with
+// the next of the sorted units
+void check_units(TreeReader* tree, char* where, size_t depth, size_t* next)
+{
+  char code[MAX_LINE];
+  if (!read_node(tree, code, MAX_LINE)) {
+    unit_differs(where, "tree ends early");
+  }
+  if (code[0] == 'X' && depth < g_depth) {
+    where[depth] = '0';
+    where[depth + 1] = '\0';
+    check_units(tree, where, depth + 1, next);
+    where[depth] = '1';
+    where[depth + 1] = '\0';
+    check_units(tree, where, depth + 1, next);
+    where[depth] = '\0';
+    return;
+  }
+  uint64_t hash = FNV_OFFSET;
+  size_t leaves = 0;
+  size_t open_nodes = 1;
+  while (true) {
+    hash = fnv1a(hash, code, strlen(code));
+    if (code[0] == 'X') {
+      ++open_nodes;
+    } else {
+      leaves += leaf_code_index(code[0]) >= 0;
+      --open_nodes;
+    }
+    if (open_nodes == 0) {
+      break;
+    }
+    if (!read_node(tree, code, MAX_LINE)) {
+      unit_differs(where, "tree ends early");
+    }
+  }
+  if (*next == g_intervals.size()) {
+    unit_differs(where, "no such unit");
+  }
+  const Interval& u = g_intervals[(*next)++];
+  if (strcmp(u.boxcode, where) != 0) {
+    unit_differs(where, "no such unit");
+  }
+  if (u.leaves != leaves || u.hash != hash) {
+    unit_differs(where, "leaves or hash");
+  }
+}
+
+int main(int argc, char** argv)
+{
+  const char* location = 0;
+  int opt;
+  while ((opt = getopt(argc, argv, "t:")) != -1) {
+    if (opt == 't') {
+      location = optarg;
+    } else {
+      optind = argc + 1;
+    }
+  }
+  if (optind >= argc) {
+    fprintf(stderr, "Usage: shardmerge [-t tree_location|-] record_file...\n");
+    exit(1);
+  }
+  for (int i = optind; i < argc; ++i) {
+    read_record(argv[i]);
+  }
+  for (int i = 0; i < g_count; ++i) {
+    if (!g_seen[i]) {
+      fprintf(stderr, "Fatal: missing shard %d of %d\n", i, g_count);
+      exit(3);
+    }
+  }
+  // The units must tile the box of the root without gaps or overlaps
+  std::sort(g_intervals.begin(), g_intervals.end(), interval_less);
+  Interval root = unit_interval(g_root);
+  uint64_t next = root.start;
+  for (size_t i = 0; i < g_intervals.size(); ++i) {
+    Interval* u = &g_intervals[i];
+    if (u->start != next) {
+      fprintf(stderr, "Fatal: units %s at %s\n", u->start < next ? "overlap" : "missing",
+          strlen(u->boxcode) ? u->boxcode : "root");
+      exit(3);
+    }
+    next = u->end;
+  }
+  if (next != root.end) {
+    fprintf(stderr, "Fatal: units missing at the end of the tree\n");
+    exit(3);
+  }
+  if (location) {
+    TreeReader tree;
+    open_tree(&tree, strcmp(location, "-") == 0 ? NULL : location);
+    tree.prefetch_threads = 1;
+    tree.prefetch_bytes = PREFETCH_BYTES;
+    if (!seek_tree(&tree, g_root)) {
+      fprintf(stderr, "Fatal: no subtree at %s\n", strlen(g_root) ? g_root : "root");
+      exit(2);
+    }
+    char where[MAX_LINE];
+    strcpy(where, g_root);
+    size_t unit = 0;
+    check_units(&tree, where, strlen(where), &unit);
+    close_tree(&tree);
+    printf("Every unit matches the tree at %s\n", location);
+  }
+
+  printf("Merged %d %s shards of %s: %lu units at depth %lu cover the tree exactly once\n",
+      g_count, g_program, strlen(g_root) ? g_root : "root", g_intervals.size(), g_depth);
+  printf("Conditions:");
+  for (int i = 0; i < 16; ++i) {
+    printf(" %c:%lu", tree_leaf_codes[i], g_conditions[i]);
+  }
+  printf("\n");
+  printf("Successfully verified all %lu nodes\n", g_leaves);
+  exit(0);
+}
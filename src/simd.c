@@ -0,0 +1,126 @@
+#include <stdio.h>
+#include <string.h>
+#include <emmintrin.h>
+
+#include "simd.h"
+#include "simd_kernels.h"
+
+void set_lane(ACJLanes& l, int lane, const ACJ& x)
+{
+  const XComplex* f[4] = { &x.f, &x.f0, &x.f1, &x.f2 };
+  for (int k = 0; k < 4; ++k) {
+    l.re[k][lane] = f[k]->re;
+    l.im[k][lane] = f[k]->im;
+  }
+  l.e[lane] = x.e;
+  l.size[lane] = x.size;
+}
+
+// The size is that of the jet set, or computed by the kernels as by the
+// constructor, so it is copied rather than computed again, which could
+// raise an underflow the operation itself didn't
+const ACJ get_lane(const ACJLanes& l, int lane)
+{
+  ACJ x;
+  XComplex* f[4] = { &x.f, &x.f0, &x.f1, &x.f2 };
+  for (int k = 0; k < 4; ++k) {
+    *f[k] = XComplex(l.re[k][lane], l.im[k][lane]);
+  }
+  x.e = l.e[lane];
+  x.size = l.size[lane];
+  return x;
+}
+
+void set_lane(SL2ACJLanes& l, int lane, const SL2ACJ& x)
+{
+  set_lane(l.a, lane, x.a);
+  set_lane(l.b, lane, x.b);
+  set_lane(l.c, lane, x.c);
+  set_lane(l.d, lane, x.d);
+}
+
+const SL2ACJ get_lane(const SL2ACJLanes& l, int lane)
+{
+  return SL2ACJ(get_lane(l.a, lane), get_lane(l.b, lane),
+      get_lane(l.c, lane), get_lane(l.d, lane));
+}
+
+// The operators of ACJ.h
+const ACJ scalar_add(const ACJ& x, const ACJ& y) { return x + y; }
+const ACJ scalar_sub(const ACJ& x, const ACJ& y) { return x - y; }
+const ACJ scalar_mul(const ACJ& x, const ACJ& y) { return x * y; }
+const ACJ scalar_div(const ACJ& x, const ACJ& y) { return x / y; }
+const ACJ scalar_scale(const ACJ& x, double y) { return x * y; }
+const ACJ scalar_shrink(const ACJ& x, double y) { return x / y; }
+
+void scalar_mul_lanes(const SL2ACJLanes& x, const SL2ACJLanes& y, SL2ACJLanes& r)
+{
+  for (int i = 0; i < SIMD_LANES; ++i) {
+    set_lane(r, i, get_lane(x, i) * get_lane(y, i));
+  }
+}
+
+void scalar_translate_lanes(const ACJLanes& T, SL2ACJLanes& w)
+{
+  for (int i = 0; i < SIMD_LANES; ++i) {
+    ACJ t = get_lane(T, i);
+    SL2ACJ v = get_lane(w, i);
+    set_lane(w, i, SL2ACJ(v.a + t * v.c, v.b + t * v.d, v.c, v.d));
+  }
+}
+
+const SimdOps g_scalar_ops = {
+  "scalar", scalar_add, scalar_sub, scalar_mul, scalar_div,
+  scalar_scale, scalar_shrink, scalar_mul_lanes, scalar_translate_lanes
+};
+
+SimdOps g_simd = g_scalar_ops;
+
+struct Vec2 {
+  enum { width = 2 };
+  __m128d v;
+  static Vec2 make(__m128d v) { Vec2 r; r.v = v; return r; }
+  static Vec2 load(const double* p) { return make(_mm_load_pd(p)); }
+  static Vec2 set1(double x) { return make(_mm_set1_pd(x)); }
+  void store(double* p) const { _mm_store_pd(p, v); }
+};
+
+inline Vec2 operator+(Vec2 a, Vec2 b) { return Vec2::make(_mm_add_pd(a.v, b.v)); }
+inline Vec2 operator-(Vec2 a, Vec2 b) { return Vec2::make(_mm_sub_pd(a.v, b.v)); }
+inline Vec2 operator*(Vec2 a, Vec2 b) { return Vec2::make(_mm_mul_pd(a.v, b.v)); }
+inline Vec2 operator/(Vec2 a, Vec2 b) { return Vec2::make(_mm_div_pd(a.v, b.v)); }
+inline Vec2 vabs(Vec2 a) { return Vec2::make(_mm_andnot_pd(_mm_set1_pd(-0.0), a.v)); }
+
+const SimdOps g_sse2_ops = {
+  "sse2", add_kernel<Vec2>, sub_kernel<Vec2>, mul_kernel<Vec2>,
+  div_kernel<Vec2>, scale_kernel<Vec2>, shrink_kernel<Vec2>,
+  mul_sl2_lanes<Vec2>, translate_lanes<Vec2>
+};
+
+bool init_simd(const char* level)
+{
+  __builtin_cpu_init();
+  bool avx2 = __builtin_cpu_supports("avx2");
+  if (level == NULL) {
+    g_simd = avx2 ? g_avx2_ops : g_sse2_ops;
+  } else if (strcmp(level, "avx2") == 0) {
+    if (!avx2) return false;
+    g_simd = g_avx2_ops;
+  } else if (strcmp(level, "sse2") == 0) {
+    g_simd = g_sse2_ops;
+  } else if (strcmp(level, "scalar") == 0) {
+    g_simd = g_scalar_ops;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+const SL2ACJ sl2acj_mul(const SL2ACJ& x, const SL2ACJ& y)
+{
+  return SL2ACJ(
+      acj_add(acj_mul(x.a, y.a), acj_mul(x.b, y.c)),
+      acj_add(acj_mul(x.a, y.b), acj_mul(x.b, y.d)),
+      acj_add(acj_mul(x.c, y.a), acj_mul(x.d, y.c)),
+      acj_add(acj_mul(x.c, y.b), acj_mul(x.d, y.d)));
+}
@@ -0,0 +1,83 @@
+#ifndef _simd_h_
+#define _simd_h_
+#include "SL2ACJ.h"
+
+// Vector ACJ arithmetic
+//
+// The operators of ACJ.h compute the components f, f0, f1 and f2 of a jet
+// one at a time. The kernels here compute them in the lanes of SSE2 or AVX2
+// registers, each lane doing the IEEE operations of ACJ.h in the same
+// order, so values and error bounds are bit-identical to the operators.
+// Lanes that ACJ.h has nothing to compute for are fed zeros, which raise
+// no underflow or overflow. The error terms are summed in scalar code in
+// the order of ACJ.h.
+//
+// The kernels are built with -O2, and the proof depends on the compiler
+// not doing the following:
+// - reassociating, contracting into FMA or otherwise changing the IEEE
+//   operations: no -ffast-math, and -mno-fma as everywhere else;
+// - folding or moving operations across the flags: -frounding-math;
+// - dropping an operation whose value is unused but whose underflow or
+//   overflow flags ACJ.h raises: such values go to keep_flags() in
+//   simd_kernels.h, which stores them to a volatile.
+
+// The jets of up to SIMD_LANES boxes, component by component, so one
+// word can be evaluated over several boxes with each IEEE operation
+// running across the boxes. Unused lanes hold copies of a used one.
+#define SIMD_LANES 4
+
+struct alignas(32) ACJLanes {
+  double re[4][SIMD_LANES]; // f, f0, f1, f2
+  double im[4][SIMD_LANES];
+  double e[SIMD_LANES];
+  double size[SIMD_LANES];
+};
+
+struct SL2ACJLanes {
+  ACJLanes a, b, c, d;
+};
+
+void set_lane(ACJLanes& l, int lane, const ACJ& x);
+
+const ACJ get_lane(const ACJLanes& l, int lane);
+
+void set_lane(SL2ACJLanes& l, int lane, const SL2ACJ& x);
+
+const SL2ACJ get_lane(const SL2ACJLanes& l, int lane);
+
+typedef struct {
+  const char* name;
+  const ACJ (*add)(const ACJ& x, const ACJ& y);
+  const ACJ (*sub)(const ACJ& x, const ACJ& y);
+  const ACJ (*mul)(const ACJ& x, const ACJ& y);
+  const ACJ (*div)(const ACJ& x, const ACJ& y);
+  const ACJ (*scale)(const ACJ& x, double y); // x * y
+  const ACJ (*shrink)(const ACJ& x, double y); // x / y
+  // r = x * y in each lane, r apart from x and y
+  void (*mul_lanes)(const SL2ACJLanes& x, const SL2ACJLanes& y, SL2ACJLanes& r);
+  // w = (1 T; 0 1) * w in each lane, as a translation in construct_word()
+  void (*translate_lanes)(const ACJLanes& T, SL2ACJLanes& w);
+} SimdOps;
+
+// The kernels in use, the operators of ACJ.h until init_simd()
+extern SimdOps g_simd;
+
+extern const SimdOps g_scalar_ops;
+extern const SimdOps g_sse2_ops;
+extern const SimdOps g_avx2_ops;
+
+// Picks the kernels named level, "avx2", "sse2" or "scalar", or the widest
+// the CPU runs if level is NULL. Returns false if the CPU can't run level.
+bool init_simd(const char* level);
+
+inline const ACJ acj_add(const ACJ& x, const ACJ& y) { return g_simd.add(x, y); }
+inline const ACJ acj_sub(const ACJ& x, const ACJ& y) { return g_simd.sub(x, y); }
+inline const ACJ acj_mul(const ACJ& x, const ACJ& y) { return g_simd.mul(x, y); }
+inline const ACJ acj_div(const ACJ& x, const ACJ& y) { return g_simd.div(x, y); }
+inline const ACJ acj_scale(const ACJ& x, double y) { return g_simd.scale(x, y); }
+inline const ACJ acj_shrink(const ACJ& x, double y) { return g_simd.shrink(x, y); }
+
+// operator*(SL2ACJ, SL2ACJ) with the kernels
+const SL2ACJ sl2acj_mul(const SL2ACJ& x, const SL2ACJ& y);
+
+#endif // _simd_h_
@@ -0,0 +1,37 @@
+#include <immintrin.h>
+
+#include "simd.h"
+
+// Only run if init_simd() finds AVX2. The functions of ACJ.h and
+// Complex.h are compiled above for any CPU, and the kernels below for AVX2.
+#pragma GCC push_options
+#pragma GCC target("avx2")
+
+#include "simd_kernels.h"
+
+namespace {
+
+struct Vec4 {
+  enum { width = 4 };
+  __m256d v;
+  static Vec4 make(__m256d v) { Vec4 r; r.v = v; return r; }
+  static Vec4 load(const double* p) { return make(_mm256_load_pd(p)); }
+  static Vec4 set1(double x) { return make(_mm256_set1_pd(x)); }
+  void store(double* p) const { _mm256_store_pd(p, v); }
+};
+
+inline Vec4 operator+(Vec4 a, Vec4 b) { return Vec4::make(_mm256_add_pd(a.v, b.v)); }
+inline Vec4 operator-(Vec4 a, Vec4 b) { return Vec4::make(_mm256_sub_pd(a.v, b.v)); }
+inline Vec4 operator*(Vec4 a, Vec4 b) { return Vec4::make(_mm256_mul_pd(a.v, b.v)); }
+inline Vec4 operator/(Vec4 a, Vec4 b) { return Vec4::make(_mm256_div_pd(a.v, b.v)); }
+inline Vec4 vabs(Vec4 a) { return Vec4::make(_mm256_andnot_pd(_mm256_set1_pd(-0.0), a.v)); }
+
+} // namespace
+
+const SimdOps g_avx2_ops = {
+  "avx2", add_kernel<Vec4>, sub_kernel<Vec4>, mul_kernel<Vec4>,
+  div_kernel<Vec4>, scale_kernel<Vec4>, shrink_kernel<Vec4>,
+  mul_sl2_lanes<Vec4>, translate_lanes<Vec4>
+};
+
+#pragma GCC pop_options
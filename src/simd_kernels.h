@@ -0,0 +1,343 @@
+#ifndef _simd_kernels_h_
+#define _simd_kernels_h_
+#include "simd.h"
+
+// The ACJ kernels of simd.h for a vector type V of V::width doubles, with
+// V::load, V::set1, store, +, -, *, / and vabs. Lane k of the arrays below
+// holds component k of a jet: f, f0, f1, f2. Each file instantiating them
+// is compiled for its instruction set, so everything here has internal
+// linkage, and the linker can't pick another file's copy.
+
+namespace {
+
+struct alignas(32) Lanes {
+  double re[4];
+  double im[4];
+};
+
+inline void get_lanes(const ACJ& x, Lanes& l)
+{
+  l.re[0] = x.f.re; l.im[0] = x.f.im;
+  l.re[1] = x.f0.re; l.im[1] = x.f0.im;
+  l.re[2] = x.f1.re; l.im[2] = x.f1.im;
+  l.re[3] = x.f2.re; l.im[3] = x.f2.im;
+}
+
+inline const ACJ from_lanes(const Lanes& l, double error)
+{
+  return ACJ(XComplex(l.re[0], l.im[0]), XComplex(l.re[1], l.im[1]),
+      XComplex(l.re[2], l.im[2]), XComplex(l.re[3], l.im[3]), error);
+}
+
+// Keeps the operations of x for the flags they raise, see simd.h
+inline void keep_flags(double x)
+{
+  volatile double sink = x;
+  (void) sink;
+}
+
+// The errors of the components, added as in ACJ.h
+inline double lane_errors(const double* e)
+{
+  return (e[0] + e[1]) + (e[2] + e[3]);
+}
+
+// XComplex + XComplex and XComplex - XComplex
+template <class V, bool subtract>
+const ACJ add_lanes(const ACJ& x, const ACJ& y)
+{
+  Lanes a, b, r;
+  alignas(32) double e[4];
+  get_lanes(x, a);
+  get_lanes(y, b);
+  for (int k = 0; k < 4; k += V::width) {
+    V re = subtract ? V::load(a.re + k) - V::load(b.re + k)
+                    : V::load(a.re + k) + V::load(b.re + k);
+    V im = subtract ? V::load(a.im + k) - V::load(b.im + k)
+                    : V::load(a.im + k) + V::load(b.im + k);
+    re.store(r.re + k);
+    im.store(r.im + k);
+    (V::set1(HALFEPS) * (V::set1(1 + EPS) * (vabs(re) + vabs(im)))).store(e + k);
+  }
+  double r_error = (1 + 3 * EPS) * ((x.e + y.e) + lane_errors(e));
+  return from_lanes(r, r_error);
+}
+
+template <class V>
+const ACJ add_kernel(const ACJ& x, const ACJ& y)
+{
+  return add_lanes<V, false>(x, y);
+}
+
+template <class V>
+const ACJ sub_kernel(const ACJ& x, const ACJ& y)
+{
+  return add_lanes<V, true>(x, y);
+}
+
+// XComplex * double and XComplex / double
+template <class V, bool divide>
+const ACJ scale_lanes(const ACJ& x, double y)
+{
+  Lanes a, r;
+  alignas(32) double e[4];
+  get_lanes(x, a);
+  V s = V::set1(y);
+  for (int k = 0; k < 4; k += V::width) {
+    V re = divide ? V::load(a.re + k) / s : V::load(a.re + k) * s;
+    V im = divide ? V::load(a.im + k) / s : V::load(a.im + k) * s;
+    re.store(r.re + k);
+    im.store(r.im + k);
+    (V::set1(HALFEPS) * (V::set1(1 + EPS) * (vabs(re) + vabs(im)))).store(e + k);
+  }
+  double x_error = divide ? x.e / fabs(y) : x.e * fabs(y);
+  double r_error = (1 + 3 * EPS) * (x_error + lane_errors(e));
+  return from_lanes(r, r_error);
+}
+
+template <class V>
+const ACJ scale_kernel(const ACJ& x, double y)
+{
+  return scale_lanes<V, false>(x, y);
+}
+
+template <class V>
+const ACJ shrink_kernel(const ACJ& x, double y)
+{
+  return scale_lanes<V, true>(x, y);
+}
+
+// p = s * b lane by lane, an XComplex * XComplex with s the same in every
+// lane, and its error
+template <class V>
+void product_lanes(double sr, double si, const Lanes& b, Lanes& p, double* e)
+{
+  V xr = V::set1(sr);
+  V xi = V::set1(si);
+  for (int k = 0; k < 4; k += V::width) {
+    V yr = V::load(b.re + k);
+    V yi = V::load(b.im + k);
+    V re1 = xr * yr, re2 = xi * yi;
+    V im1 = xr * yi, im2 = xi * yr;
+    (re1 - re2).store(p.re + k);
+    (im1 + im2).store(p.im + k);
+    (V::set1(EPS) * (V::set1(1 + 2 * EPS)
+        * ((vabs(re1) + vabs(re2)) + (vabs(im1) + vabs(im2))))).store(e + k);
+  }
+}
+
+// AComplex + AComplex, or AComplex - AComplex, lane by lane
+template <class V, bool subtract>
+void sum_lanes(const Lanes& p, const double* pe, const Lanes& q,
+    const double* qe, Lanes& r, double* e)
+{
+  for (int k = 0; k < 4; k += V::width) {
+    V re = subtract ? V::load(p.re + k) - V::load(q.re + k)
+                    : V::load(p.re + k) + V::load(q.re + k);
+    V im = subtract ? V::load(p.im + k) - V::load(q.im + k)
+                    : V::load(p.im + k) + V::load(q.im + k);
+    re.store(r.re + k);
+    im.store(r.im + k);
+    (V::set1(1 + 2 * EPS) * (V::set1(HALFEPS) * (vabs(re) + vabs(im))
+        + (V::load(pe + k) + V::load(qe + k)))).store(e + k);
+  }
+}
+
+// Clears lane 0, which ACJ.h computes differently
+inline void clear_lane0(Lanes& l, double* e)
+{
+  l.re[0] = l.im[0] = 0;
+  e[0] = 0;
+}
+
+template <class V>
+const ACJ mul_kernel(const ACJ& x, const ACJ& y)
+{
+  double xdist = size(x);
+  double ydist = size(y);
+  double ax = absUB(x.f), ay = absUB(y.f);
+
+  // p = x.f * (y.f, y.f0, y.f1, y.f2), q = (0, x.f0, x.f1, x.f2) * y.f
+  Lanes a, b, p, q, r;
+  alignas(32) double pe[4], qe[4], e[4];
+  get_lanes(x, a);
+  get_lanes(y, b);
+  product_lanes<V>(x.f.re, x.f.im, b, p, pe);
+  a.re[0] = a.im[0] = 0;
+  product_lanes<V>(y.f.re, y.f.im, a, q, qe);
+
+  // r_f = x.f * y.f, and r_fk = x.f * y.fk + x.fk * y.f
+  double r_re = p.re[0], r_im = p.im[0], r_e = pe[0];
+  clear_lane0(p, pe);
+  sum_lanes<V, false>(p, pe, q, qe, r, e);
+  r.re[0] = r_re; r.im[0] = r_im; e[0] = r_e;
+
+  double A = (xdist + x.e) * (ydist + y.e);
+  double B = ax * y.e + ay * x.e;
+  double C = lane_errors(e);
+  double r_error = (1 + 3 * EPS) * (A + (B + C));
+  return from_lanes(r, r_error);
+}
+
+template <class V>
+const ACJ div_kernel(const ACJ& x, const ACJ& y)
+{
+  double xdist = size(x);
+  double ydist = size(y);
+  double ax = absUB(x.f), ay = absLB(y.f);
+  double D = ay - (1 + EPS) * (y.e + ydist);
+  if (!(D > 0)) {
+    keep_flags(ax); // ACJ.h computes it on this path too
+    return x / y;
+  }
+  AComplex den = (y.f * y.f);
+  AComplex r_f = x.f / y.f;
+
+  // d = (0, x.f0, x.f1, x.f2) * y.f - x.f * (0, y.f0, y.f1, y.f2)
+  Lanes a, b, p, q, d, r;
+  alignas(32) double pe[4], qe[4], de[4], e[4];
+  get_lanes(x, a);
+  get_lanes(y, b);
+  a.re[0] = a.im[0] = 0;
+  b.re[0] = b.im[0] = 0;
+  product_lanes<V>(y.f.re, y.f.im, a, q, qe);
+  product_lanes<V>(x.f.re, x.f.im, b, p, pe);
+  sum_lanes<V, true>(q, qe, p, pe, d, de);
+
+  // AComplex / AComplex by den in every lane
+  double nrm = den.z.re * den.z.re + den.z.im * den.z.im;
+  assert(den.e * den.e < (10000 * EPS * EPS) * nrm);
+  V yr = V::set1(den.z.re), yi = V::set1(den.z.im), n = V::set1(nrm);
+  V ye = V::set1(den.e);
+  V y_abs = V::set1(fabs(den.z.re) + fabs(den.z.im));
+  for (int k = 0; k < 4; k += V::width) {
+    V xr = V::load(d.re + k), xi = V::load(d.im + k), xe = V::load(de + k);
+    V xryr = xr * yr, xiyi = xi * yi;
+    V xiyr = xi * yr, xryi = xr * yi;
+    V A = (vabs(xryr) + vabs(xiyi)) + (vabs(xiyr) + vabs(xryi));
+    V B = xe * y_abs + ye * (vabs(xr) + vabs(xi));
+    (V::set1(1 + 4 * EPS) * ((V::set1(5 * HALFEPS) * A
+        + V::set1(1 + 103 * EPS) * B) / n)).store(e + k);
+    ((xryr + xiyi) / n).store(r.re + k);
+    ((xiyr - xryi) / n).store(r.im + k);
+  }
+  r.re[0] = r_f.z.re; r.im[0] = r_f.z.im; e[0] = r_f.e;
+
+  double A = (ax + (xdist + x.e)) / D;
+  double B = (ax / ay + xdist / ay) + (ydist * ax) / (ay * ay);
+  double C = lane_errors(e);
+  double r_error = (1 + 3 * EPS) * (((1 + 3 * EPS) * A - (1 - 3 * EPS) * B) + C);
+  return from_lanes(r, r_error);
+}
+
+// Kernels over the boxes of ACJLanes. Each lane does the operations of
+// ACJ.h for its box, and the sizes are computed as by the constructor.
+
+inline void lane_sizes(ACJLanes& r)
+{
+  for (int i = 0; i < SIMD_LANES; ++i) {
+    r.size[i] = (1 + 2 * EPS) * (absUB(XComplex(r.re[1][i], r.im[1][i]))
+        + (absUB(XComplex(r.re[2][i], r.im[2][i]))
+          + absUB(XComplex(r.re[3][i], r.im[3][i]))));
+  }
+}
+
+// ACJ + ACJ, where r may be x or y
+template <class V>
+void add_acj_lanes(const ACJLanes& x, const ACJLanes& y, ACJLanes& r)
+{
+  for (int j = 0; j < SIMD_LANES; j += V::width) {
+    V e[4];
+    for (int k = 0; k < 4; ++k) {
+      V re = V::load(x.re[k] + j) + V::load(y.re[k] + j);
+      V im = V::load(x.im[k] + j) + V::load(y.im[k] + j);
+      re.store(r.re[k] + j);
+      im.store(r.im[k] + j);
+      e[k] = V::set1(HALFEPS) * (V::set1(1 + EPS) * (vabs(re) + vabs(im)));
+    }
+    (V::set1(1 + 3 * EPS) * ((V::load(x.e + j) + V::load(y.e + j))
+        + ((e[0] + e[1]) + (e[2] + e[3])))).store(r.e + j);
+  }
+  lane_sizes(r);
+}
+
+// XComplex * XComplex
+template <class V>
+inline void mul_complex(V xr, V xi, V yr, V yi, V& re, V& im, V& e)
+{
+  V re1 = xr * yr, re2 = xi * yi;
+  V im1 = xr * yi, im2 = xi * yr;
+  re = re1 - re2;
+  im = im1 + im2;
+  e = V::set1(EPS) * (V::set1(1 + 2 * EPS)
+      * ((vabs(re1) + vabs(re2)) + (vabs(im1) + vabs(im2))));
+}
+
+// ACJ * ACJ, where r is neither x nor y
+template <class V>
+void mul_acj_lanes(const ACJLanes& x, const ACJLanes& y, ACJLanes& r)
+{
+  alignas(32) double ax[SIMD_LANES], ay[SIMD_LANES];
+  for (int i = 0; i < SIMD_LANES; ++i) {
+    ax[i] = absUB(XComplex(x.re[0][i], x.im[0][i]));
+    ay[i] = absUB(XComplex(y.re[0][i], y.im[0][i]));
+  }
+  for (int j = 0; j < SIMD_LANES; j += V::width) {
+    V xr = V::load(x.re[0] + j), xi = V::load(x.im[0] + j);
+    V yr = V::load(y.re[0] + j), yi = V::load(y.im[0] + j);
+    V re, im, e[4];
+    mul_complex(xr, xi, yr, yi, re, im, e[0]);
+    re.store(r.re[0] + j);
+    im.store(r.im[0] + j);
+    for (int k = 1; k < 4; ++k) {
+      // x.f * y.fk + x.fk * y.f
+      V p_re, p_im, p_e, q_re, q_im, q_e;
+      mul_complex(xr, xi, V::load(y.re[k] + j), V::load(y.im[k] + j), p_re, p_im, p_e);
+      mul_complex(V::load(x.re[k] + j), V::load(x.im[k] + j), yr, yi, q_re, q_im, q_e);
+      re = p_re + q_re;
+      im = p_im + q_im;
+      re.store(r.re[k] + j);
+      im.store(r.im[k] + j);
+      e[k] = V::set1(1 + 2 * EPS) * (V::set1(HALFEPS) * (vabs(re) + vabs(im))
+          + (p_e + q_e));
+    }
+    V x_e = V::load(x.e + j), y_e = V::load(y.e + j);
+    V A = (V::load(x.size + j) + x_e) * (V::load(y.size + j) + y_e);
+    V B = V::load(ax + j) * y_e + V::load(ay + j) * x_e;
+    V C = (e[0] + e[1]) + (e[2] + e[3]);
+    (V::set1(1 + 3 * EPS) * (A + (B + C))).store(r.e + j);
+  }
+  lane_sizes(r);
+}
+
+template <class V>
+void mul_sl2_lanes(const SL2ACJLanes& x, const SL2ACJLanes& y, SL2ACJLanes& r)
+{
+  ACJLanes p, q;
+  mul_acj_lanes<V>(x.a, y.a, p);
+  mul_acj_lanes<V>(x.b, y.c, q);
+  add_acj_lanes<V>(p, q, r.a);
+  mul_acj_lanes<V>(x.a, y.b, p);
+  mul_acj_lanes<V>(x.b, y.d, q);
+  add_acj_lanes<V>(p, q, r.b);
+  mul_acj_lanes<V>(x.c, y.a, p);
+  mul_acj_lanes<V>(x.d, y.c, q);
+  add_acj_lanes<V>(p, q, r.c);
+  mul_acj_lanes<V>(x.c, y.b, p);
+  mul_acj_lanes<V>(x.d, y.d, q);
+  add_acj_lanes<V>(p, q, r.d);
+}
+
+template <class V>
+void translate_lanes(const ACJLanes& T, SL2ACJLanes& w)
+{
+  ACJLanes p;
+  mul_acj_lanes<V>(T, w.c, p);
+  add_acj_lanes<V>(w.a, p, w.a);
+  mul_acj_lanes<V>(T, w.d, p);
+  add_acj_lanes<V>(w.b, p, w.b);
+}
+
+} // namespace
+
+#endif // _simd_kernels_h_
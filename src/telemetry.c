@@ -0,0 +1,178 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "telemetry.h"
+#include "tree.h"
+
+bool g_telemetry = false;
+
+__thread TelemetryCounters* t_counters = 0;
+TelemetryCounters* g_all_counters = 0;
+pthread_mutex_t g_counters_lock = PTHREAD_MUTEX_INITIALIZER;
+
+const char* g_telemetry_program = "";
+int g_telemetry_interval = 10;
+FILE* g_stats = 0;
+size_t g_total_leaves = 0;
+size_t g_done_leaves = 0;
+double g_start_time = 0;
+
+pthread_t g_reporter;
+pthread_mutex_t g_reporter_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t g_reporter_stop = PTHREAD_COND_INITIALIZER;
+bool g_stopping = false;
+
+// Counters are never freed, so those of finished threads still add up
+TelemetryCounters* telemetry_counters()
+{
+  if (!t_counters) {
+    t_counters = (TelemetryCounters*) calloc(1, sizeof(TelemetryCounters));
+    pthread_mutex_lock(&g_counters_lock);
+    t_counters->next = g_all_counters;
+    g_all_counters = t_counters;
+    pthread_mutex_unlock(&g_counters_lock);
+  }
+  return t_counters;
+}
+
+double telemetry_clock()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+// Sums the counters of every thread, the depth is the deepest current one
+void sum_counters(TelemetryCounters* sum)
+{
+  memset(sum, 0, sizeof(TelemetryCounters));
+  pthread_mutex_lock(&g_counters_lock);
+  for (TelemetryCounters* c = g_all_counters; c; c = c->next) {
+    sum->nodes += __atomic_load_n(&c->nodes, __ATOMIC_RELAXED);
+    sum->bytes += __atomic_load_n(&c->bytes, __ATOMIC_RELAXED);
+    for (int i = 0; i < 16; ++i) {
+      sum->leaves[i] += __atomic_load_n(&c->leaves[i], __ATOMIC_RELAXED);
+    }
+    double seconds;
+    __atomic_load(&c->check_seconds, &seconds, __ATOMIC_RELAXED);
+    sum->check_seconds += seconds;
+    size_t depth = __atomic_load_n(&c->depth, __ATOMIC_RELAXED);
+    if (depth > sum->depth) {
+      sum->depth = depth;
+    }
+  }
+  pthread_mutex_unlock(&g_counters_lock);
+}
+
+void format_time(char* buf, double seconds)
+{
+  long s = (long) seconds;
+  sprintf(buf, "%02ld:%02ld:%02ld", s / 3600, (s / 60) % 60, s % 60);
+}
+
+void report(const TelemetryCounters* now, const TelemetryCounters* last,
+    double elapsed, double interval)
+{
+  size_t leaves = 0;
+  size_t last_leaves = 0;
+  for (int i = 0; i < 16; ++i) {
+    leaves += now->leaves[i];
+    last_leaves += last->leaves[i];
+  }
+  double leaf_rate = (leaves - last_leaves) / interval;
+  leaves += g_done_leaves;
+  char line[1024];
+  char clock[32];
+  format_time(clock, elapsed);
+  int len = sprintf(line, "[%s %s] leaves %lu", g_telemetry_program, clock, leaves);
+  if (g_total_leaves) {
+    len += sprintf(line + len, " (%.2f%%)", 100.0 * leaves / g_total_leaves);
+  }
+  len += sprintf(line + len, " nodes/s %.0f leaves/s %.0f MB/s %.1f depth %lu busy %.1f",
+      (now->nodes - last->nodes) / interval, leaf_rate,
+      (now->bytes - last->bytes) / interval / 1e6, now->depth,
+      (now->check_seconds - last->check_seconds) / interval);
+  if (g_total_leaves && leaf_rate > 0 && leaves <= g_total_leaves) {
+    char eta[32];
+    format_time(eta, (g_total_leaves - leaves) / leaf_rate);
+    len += sprintf(line + len, " eta %s", eta);
+  }
+  len += sprintf(line + len, " |");
+  for (int i = 0; i < 16; ++i) {
+    if (now->leaves[i] > 0) {
+      len += sprintf(line + len, " %c:%.0f/s", tree_leaf_codes[i],
+          (now->leaves[i] - last->leaves[i]) / interval);
+    }
+  }
+  fprintf(g_stats, "%s\n", line);
+  fflush(g_stats);
+}
+
+void* run_reporter(void* arg)
+{
+  TelemetryCounters last;
+  memset(&last, 0, sizeof(last));
+  double last_time = g_start_time;
+  pthread_mutex_lock(&g_reporter_lock);
+  while (true) {
+    struct timespec until;
+    clock_gettime(CLOCK_REALTIME, &until);
+    until.tv_sec += g_telemetry_interval;
+    while (!g_stopping
+        && pthread_cond_timedwait(&g_reporter_stop, &g_reporter_lock, &until) == 0) {}
+    double now_time = telemetry_clock();
+    TelemetryCounters now;
+    sum_counters(&now);
+    if (now_time > last_time) {
+      report(&now, &last, now_time - g_start_time, now_time - last_time);
+    }
+    last = now;
+    last_time = now_time;
+    if (g_stopping) {
+      break;
+    }
+  }
+  pthread_mutex_unlock(&g_reporter_lock);
+  return 0;
+}
+
+void start_telemetry(const char* program, int interval, const char* stats_path,
+    size_t total_leaves, size_t done_leaves)
+{
+  g_telemetry_program = program;
+  g_telemetry_interval = interval;
+  g_total_leaves = total_leaves;
+  g_done_leaves = done_leaves;
+  g_stats = stderr;
+  if (stats_path) {
+    g_stats = fopen(stats_path, "a");
+    if (!g_stats) {
+      fprintf(stderr, "Fatal: failed to open stats file %s\n", stats_path);
+      exit(2);
+    }
+  }
+  g_start_time = telemetry_clock();
+  g_telemetry = true;
+  if (pthread_create(&g_reporter, NULL, run_reporter, NULL) != 0) {
+    fprintf(stderr, "Fatal: failed to start telemetry thread\n");
+    exit(2);
+  }
+}
+
+void stop_telemetry()
+{
+  if (!g_telemetry) {
+    return;
+  }
+  pthread_mutex_lock(&g_reporter_lock);
+  g_stopping = true;
+  pthread_cond_signal(&g_reporter_stop);
+  pthread_mutex_unlock(&g_reporter_lock);
+  pthread_join(g_reporter, NULL);
+  if (g_stats != stderr) {
+    fclose(g_stats);
+  }
+}
@@ -0,0 +1,49 @@
+#ifndef _telemetry_h_
+#define _telemetry_h_
+#include <stddef.h>
+
+// Throughput telemetry
+//
+// Every thread that walks the tree counts its nodes, the bytes of their
+// depth-first text, its leaves per condition code and the time spent
+// checking them in its own counters. A reporter thread sums the counters at
+// a fixed interval and writes one line to stderr or a stats file,
+//    [verify 01:02:03] leaves 123456 (12.34%) nodes/s 1000 leaves/s 500
+//    MB/s 1.2 depth 87 busy 3.9 eta 07:08:09 | 0:10/s 1:20/s ... K:5/s
+// Rates are over the last interval. busy is the number of threads checking
+// leaves on average, so a run that reads faster than it checks has busy
+// equal to its threads, and one waiting on its input has less. The ETA
+// needs the number of leaves of the tree, see tree_leaves().
+
+typedef struct TelemetryCounters {
+  size_t nodes;
+  size_t bytes;
+  size_t leaves[16];
+  double check_seconds;
+  size_t depth;
+  struct TelemetryCounters* next;
+} TelemetryCounters;
+
+extern bool g_telemetry;
+
+// The counters of the calling thread
+TelemetryCounters* telemetry_counters();
+
+// Adds n to a counter that the reporter reads concurrently
+inline void bump(size_t* counter, size_t n)
+{
+  __atomic_store_n(counter, *counter + n, __ATOMIC_RELAXED);
+}
+
+double telemetry_clock();
+
+// Starts reporting every interval seconds, to stats_path if not NULL.
+// total_leaves is 0 if not known. done_leaves were checked by an earlier
+// run, see resume_checkpoint(), and count towards the leaves reported.
+void start_telemetry(const char* program, int interval, const char* stats_path,
+    size_t total_leaves, size_t done_leaves);
+
+// Writes a last report and stops the reporter
+void stop_telemetry();
+
+#endif // _telemetry_h_
@@ -0,0 +1,807 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <fenv.h>
+#include <getopt.h>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "elimination.h"
+#include "word.h"
+#include "simd.h"
+
+// Differential tests of the faster arithmetic
+//
+// The operators of Complex.C, ACJ.C and SL2ACJ.C are the reference. Every
+// path that replaces them in the verifier, the SIMD kernels and lanes of
+// simd.h, the sparse jets of jet.h, the incremental boxes of box.h and the
+// compiled and batched words of word.h, is run here on the same inputs as
+// the reference, random and adversarial, and on boxes from build_box() and
+// words from the data. The f, f0, f1, f2, e and size of each result must
+// match the reference bit for bit, and the same underflow and overflow
+// flags must be raised. Jets may differ in the sign of zero parts, see
+// jet.h, and NaNs, which fail every test, in their sign and payload. The
+// plan of a word multiplies in another order, so its matrix only has to
+// overlap the matrix of the ops, as both bound the same word, and matrices
+// with an unbounded error are counted apart.
+
+double max_area = 5.95;
+double e2_area_min = 5.65;
+double one_over_e2_min = 0.92593;
+
+#define FP_FLAGS (FE_UNDERFLOW | FE_OVERFLOW)
+
+// Mismatches printed per check
+#define MAX_REPORTS 3
+
+const char* g_check;
+long g_cases;
+long g_mismatches;
+long g_unbounded; // not compared, see overlap()
+long g_failed_checks;
+
+void begin_check(const char* name)
+{
+  g_check = name;
+  g_cases = 0;
+  g_mismatches = 0;
+  g_unbounded = 0;
+}
+
+void end_check()
+{
+  printf("%-32s %8ld cases %8ld mismatches", g_check, g_cases, g_mismatches);
+  if (g_unbounded > 0) {
+    printf(" %8ld unbounded", g_unbounded);
+  }
+  printf("\n");
+  if (g_mismatches > 0) {
+    ++g_failed_checks;
+  }
+}
+
+bool same_double(double x, double y, bool any_zero)
+{
+  return memcmp(&x, &y, sizeof(double)) == 0 || (any_zero && x == 0 && y == 0)
+    || (isnan(x) && isnan(y));
+}
+
+bool same_xcomplex(const XComplex& x, const XComplex& y, bool any_zero)
+{
+  return same_double(x.re, y.re, any_zero) && same_double(x.im, y.im, any_zero);
+}
+
+bool same_acj(const ACJ& x, const ACJ& y, bool any_zero = false)
+{
+  return same_xcomplex(x.f, y.f, any_zero) && same_xcomplex(x.f0, y.f0, any_zero)
+    && same_xcomplex(x.f1, y.f1, any_zero) && same_xcomplex(x.f2, y.f2, any_zero)
+    && same_double(x.e, y.e, any_zero) && same_double(x.size, y.size, any_zero);
+}
+
+bool same_sl2acj(const SL2ACJ& x, const SL2ACJ& y, bool any_zero = false)
+{
+  return same_acj(x.a, y.a, any_zero) && same_acj(x.b, y.b, any_zero)
+    && same_acj(x.c, y.c, any_zero) && same_acj(x.d, y.d, any_zero);
+}
+
+void print_acj(const char* name, const ACJ& x)
+{
+  printf("    %s: f %a %a f0 %a %a f1 %a %a f2 %a %a e %a size %a\n", name,
+      x.f.re, x.f.im, x.f0.re, x.f0.im, x.f1.re, x.f1.im, x.f2.re, x.f2.im,
+      x.e, x.size);
+}
+
+// Counts a case, printing the first mismatches of the check
+bool report(bool same, int ref_flags, int alt_flags, const char* what)
+{
+  ++g_cases;
+  if (same && ref_flags == alt_flags) {
+    return true;
+  }
+  if (++g_mismatches <= MAX_REPORTS) {
+    printf("  %s: %s differs (flags %d, reference %d)\n", g_check, what,
+        alt_flags, ref_flags);
+  }
+  return false;
+}
+
+void compare(const ACJ& ref, int ref_flags, const ACJ& alt, int alt_flags,
+    const char* what, bool any_zero = false)
+{
+  if (!report(same_acj(ref, alt, any_zero), ref_flags, alt_flags, what)
+      && g_mismatches <= MAX_REPORTS) {
+    print_acj("reference", ref);
+    print_acj("alternative", alt);
+  }
+}
+
+void compare(const SL2ACJ& ref, int ref_flags, const SL2ACJ& alt, int alt_flags,
+    const char* what, bool any_zero = false)
+{
+  if (!report(same_sl2acj(ref, alt, any_zero), ref_flags, alt_flags, what)
+      && g_mismatches <= MAX_REPORTS) {
+    const ACJ* r[4] = { &ref.a, &ref.b, &ref.c, &ref.d };
+    const ACJ* a[4] = { &alt.a, &alt.b, &alt.c, &alt.d };
+    for (int i = 0; i < 4; ++i) {
+      if (!same_acj(*r[i], *a[i], any_zero)) {
+        printf("   entry %c\n", "abcd"[i]);
+        print_acj("reference", *r[i]);
+        print_acj("alternative", *a[i]);
+      }
+    }
+  }
+}
+
+// The flags raised since the last call
+int take_flags()
+{
+  int flags = fetestexcept(FP_FLAGS);
+  feclearexcept(FE_ALL_EXCEPT);
+  return flags;
+}
+
+// Inputs
+
+// Mostly values of a leaf, but also zeros of either sign, subnormals and
+// magnitudes that under or overflow when multiplied
+double adversarial_double()
+{
+  double sign = (lrand48() & 1) ? -1 : 1;
+  switch (lrand48() % 8) {
+    case 0: return sign * 0.;
+    case 1: return sign * double(lrand48() % 8);
+    case 2: return sign * ldexp(drand48(), -1074 + int(lrand48() % 60));
+    case 3: return sign * ldexp(1 + drand48(), int(lrand48() % 2046) - 1022);
+    case 4: return sign * ldexp(drand48(), int(lrand48() % 80) - 40);
+    default: return 2 * drand48() - 1;
+  }
+}
+
+XComplex random_complex(double scale)
+{
+  return XComplex(scale * (2 * drand48() - 1), scale * (2 * drand48() - 1));
+}
+
+// Jets with derivatives as small as those of a leaf, away from 0
+ACJ random_acj()
+{
+  XComplex f = random_complex(1);
+  f.re += f.re < 0 ? -1 : 1;
+  return ACJ(f, random_complex(1e-3), random_complex(1e-3),
+      random_complex(1e-3), 1e-14 * drand48());
+}
+
+XComplex adversarial_complex()
+{
+  return XComplex(adversarial_double(), adversarial_double());
+}
+
+ACJ adversarial_acj()
+{
+  double e = (lrand48() % 4 == 0) ? 0 : fabs(adversarial_double());
+  return ACJ(adversarial_complex(), adversarial_complex(),
+      adversarial_complex(), adversarial_complex(), e);
+}
+
+// Every other input is adversarial
+ACJ input_acj(long i)
+{
+  return (i & 1) ? adversarial_acj() : random_acj();
+}
+
+SL2ACJ input_sl2acj(long i)
+{
+  if (i & 1) {
+    return SL2ACJ(adversarial_acj(), adversarial_acj(), adversarial_acj(),
+        adversarial_acj());
+  }
+  // Determinant 1 up to the error terms
+  ACJ a = random_acj(), b = random_acj(), c = random_acj();
+  return SL2ACJ(a, b, c, (b * c + 1.) / a);
+}
+
+// The division of Complex.C asserts that the square of the divisor keeps
+// its relative error, which those whose value under or overflows when
+// squared don't. The verifier never divides by them.
+bool divisible(double x)
+{
+  return x == 0 || (fabs(x) > ldexp(1., -200) && fabs(x) < ldexp(1., 200));
+}
+
+ACJ input_divisor(long i)
+{
+  ACJ y = input_acj(i);
+  while (!divisible(y.f.re) || !divisible(y.f.im)) {
+    y = adversarial_acj();
+  }
+  return y;
+}
+
+// A scalar factor, nonzero so shrinking by it is defined
+double input_double(long i)
+{
+  double y = (i & 1) ? adversarial_double() : 2 * drand48() - 1;
+  return y != 0 ? y : 1;
+}
+
+// The kernels of simd.h
+
+void check_kernels(const SimdOps& ops, long n)
+{
+  char name[64];
+  snprintf(name, sizeof(name), "kernels %s", ops.name);
+  begin_check(name);
+  for (long i = 0; i < n; ++i) {
+    ACJ x = input_acj(i), y = input_divisor(i + (lrand48() & 1));
+    double d = input_double(i);
+    take_flags();
+    ACJ r_add = x + y; int f_add = take_flags();
+    ACJ r_sub = x - y; int f_sub = take_flags();
+    ACJ r_mul = x * y; int f_mul = take_flags();
+    ACJ r_div = x / y; int f_div = take_flags();
+    ACJ r_scale = x * d; int f_scale = take_flags();
+    ACJ r_shrink = x / d; int f_shrink = take_flags();
+    ACJ a_add = ops.add(x, y); compare(r_add, f_add, a_add, take_flags(), "add");
+    ACJ a_sub = ops.sub(x, y); compare(r_sub, f_sub, a_sub, take_flags(), "sub");
+    ACJ a_mul = ops.mul(x, y); compare(r_mul, f_mul, a_mul, take_flags(), "mul");
+    ACJ a_div = ops.div(x, y); compare(r_div, f_div, a_div, take_flags(), "div");
+    ACJ a_scale = ops.scale(x, d);
+    compare(r_scale, f_scale, a_scale, take_flags(), "scale");
+    ACJ a_shrink = ops.shrink(x, d);
+    compare(r_shrink, f_shrink, a_shrink, take_flags(), "shrink");
+  }
+  end_check();
+}
+
+// Each lane against the reference, flags over all lanes
+void check_lanes(const SimdOps& ops, long n)
+{
+  char name[64];
+  snprintf(name, sizeof(name), "lanes %s", ops.name);
+  begin_check(name);
+  SL2ACJLanes x, y, r;
+  ACJLanes T;
+  for (long i = 0; i < n; i += SIMD_LANES) {
+    SL2ACJ xs[SIMD_LANES], ys[SIMD_LANES], products[SIMD_LANES], moved[SIMD_LANES];
+    ACJ Ts[SIMD_LANES];
+    take_flags();
+    for (int lane = 0; lane < SIMD_LANES; ++lane) {
+      xs[lane] = input_sl2acj(i + lane);
+      ys[lane] = input_sl2acj(i + lane + 1);
+      Ts[lane] = input_acj(i + lane);
+    }
+    take_flags();
+    for (int lane = 0; lane < SIMD_LANES; ++lane) {
+      products[lane] = xs[lane] * ys[lane];
+    }
+    int f_mul = take_flags();
+    for (int lane = 0; lane < SIMD_LANES; ++lane) {
+      const SL2ACJ& w = ys[lane];
+      const ACJ& t = Ts[lane];
+      moved[lane] = SL2ACJ(w.a + t * w.c, w.b + t * w.d, w.c, w.d);
+    }
+    int f_translate = take_flags();
+    for (int lane = 0; lane < SIMD_LANES; ++lane) {
+      set_lane(x, lane, xs[lane]);
+      set_lane(y, lane, ys[lane]);
+      set_lane(T, lane, Ts[lane]);
+    }
+    take_flags();
+    ops.mul_lanes(x, y, r);
+    int a_mul = take_flags();
+    ops.translate_lanes(T, y);
+    int a_translate = take_flags();
+    for (int lane = 0; lane < SIMD_LANES; ++lane) {
+      compare(products[lane], f_mul, get_lane(r, lane), a_mul, "mul_lanes");
+      compare(moved[lane], f_translate, get_lane(y, lane), a_translate,
+          "translate_lanes");
+    }
+  }
+  end_check();
+}
+
+// The sparse jets of jet.h
+
+template <int S>
+const Jet<S> sparse(const ACJ& x)
+{
+  XComplex d[3] = { x.f0, x.f1, x.f2 };
+  return make_jet<S>(x.f, d, x.e);
+}
+
+template <int X, int Y>
+void check_jets(const char* name, long n)
+{
+  begin_check(name);
+  for (long i = 0; i < n; ++i) {
+    Jet<X> jx = sparse<X>(input_acj(i));
+    Jet<Y> jy = sparse<Y>(input_divisor(i + (lrand48() & 1)));
+    ACJ x = acj(jx), y = acj(jy);
+    double d = input_double(i);
+    take_flags();
+    ACJ r_mul = x * y; int f_mul = take_flags();
+    ACJ r_div = x / y; int f_div = take_flags();
+    ACJ r_scale = x * d; int f_scale = take_flags();
+    ACJ r_plus = x + d; int f_plus = take_flags();
+    ACJ r_minus = x - d; int f_minus = take_flags();
+    ACJ a_mul = acj(jx * jy); compare(r_mul, f_mul, a_mul, take_flags(), "*", true);
+    ACJ a_div = acj(jx / jy); compare(r_div, f_div, a_div, take_flags(), "/", true);
+    ACJ a_scale = acj(jx * d);
+    compare(r_scale, f_scale, a_scale, take_flags(), "* double", true);
+    ACJ a_plus = acj(jx + d);
+    compare(r_plus, f_plus, a_plus, take_flags(), "+ double", true);
+    ACJ a_minus = acj(jx - d);
+    compare(r_minus, f_minus, a_minus, take_flags(), "- double", true);
+    // Against a full ACJ
+    ACJ a_left = x * jy; compare(r_mul, f_mul, a_left, take_flags(), "ACJ *", true);
+    ACJ a_over = x / jy; compare(r_div, f_div, a_over, take_flags(), "ACJ /", true);
+    ACJ a_under = jx / y; compare(r_div, f_div, a_under, take_flags(), "/ ACJ", true);
+  }
+  end_check();
+}
+
+// Boxes
+
+// Random boxcodes of up to 120 digits, and the extremes of the tree
+std::vector<std::string> input_boxcodes(long n)
+{
+  std::vector<std::string> codes;
+  codes.push_back("");
+  codes.push_back(std::string(MAX_DEPTH - 1, '0'));
+  codes.push_back(std::string(MAX_DEPTH - 1, '1'));
+  codes.push_back("100000100000100000100000100000100000100000100000100000100000");
+  while (long(codes.size()) < n) {
+    std::string code(lrand48() % 121, '0');
+    for (size_t i = 0; i < code.size(); ++i) {
+      code[i] = '0' + (lrand48() & 1);
+    }
+    codes.push_back(code);
+  }
+  return codes;
+}
+
+bool same_params(const XParams& x, const XParams& y)
+{
+  return same_xcomplex(x.lattice, y.lattice, false)
+    && same_xcomplex(x.loxodromic_sqrt, y.loxodromic_sqrt, false)
+    && same_xcomplex(x.parabolic, y.parabolic, false);
+}
+
+// The cover as ACJ.h would build it
+ACJ reference_lattice(const Box& box)
+{
+  return ACJ(XComplex(box.center[3], box.center[0]),
+      XComplex(box.size[3], box.size[0]), 0., 0.);
+}
+
+ACJ reference_loxodromic_sqrt(const Box& box)
+{
+  return ACJ(XComplex(box.center[4], box.center[1]), 0.,
+      XComplex(box.size[4], box.size[1]), 0.);
+}
+
+ACJ reference_parabolic(const Box& box)
+{
+  return ACJ(XComplex(box.center[5], box.center[2]), 0., 0.,
+      XComplex(box.size[5], box.size[2]));
+}
+
+SL2ACJ reference_G(const Box& box)
+{
+  ACJ i(XComplex(0, 1));
+  ACJ P = reference_parabolic(box);
+  ACJ S = reference_loxodromic_sqrt(box);
+  return SL2ACJ((i * P) * S, i / S, i * S, ACJ(0));
+}
+
+ACJ reference_T(const Box& box, int M, int N)
+{
+  return reference_lattice(box) * double(N) + double(M);
+}
+
+// construct_word() as it was written on the operators of ACJ.h
+SL2ACJ reference_word(const Box& box, const char* word)
+{
+  ACJ one(1), zero(0);
+  SL2ACJ w(one, zero, zero, one);
+  SL2ACJ G(reference_G(box));
+  SL2ACJ g(inverse(G));
+  int M = 0;
+  int N = 0;
+  ACJ T;
+  for (size_t pos = strlen(word); pos > 0; --pos) {
+    char h = word[pos-1];
+    switch(h) {
+      case 'm': --M; break;
+      case 'M': ++M; break;
+      case 'n': --N; break;
+      case 'N': ++N; break;
+      default: {
+                 if (M != 0 || N != 0) {
+                   T = reference_T(box, M, N);
+                   w = SL2ACJ(w.a + T * w.c, w.b + T * w.d, w.c, w.d);
+                   M = N = 0;
+                 }
+                 if (h == 'g')
+                   w = g * w;
+                 else if (h == 'G')
+                   w = G * w;
+               }
+    }
+  }
+  if (M != 0 || N != 0) {
+    T = reference_T(box, M, N);
+    w = SL2ACJ(w.a + T * w.c, w.b + T * w.d, w.c, w.d);
+  }
+  return w;
+}
+
+// The box of a boxcode by build_box(), by its digits and by the children
+// of the root, and G and T of its cover against the reference
+void check_boxes(const std::vector<std::string>& codes)
+{
+  begin_check("boxes");
+  for (size_t i = 0; i < codes.size(); ++i) {
+    std::vector<char> code(codes[i].begin(), codes[i].end());
+    code.push_back('\0');
+    Box box = build_box(&code[0]);
+    BoxDigits digits;
+    for (size_t k = 0; k < codes[i].size(); ++k) {
+      digits = child(digits, codes[i][k] - '0');
+    }
+    Box boxes[2] = { build_box(box_digits(&code[0])), build_box(digits) };
+    for (int k = 0; k < 2; ++k) {
+      const Box& b = boxes[k];
+      bool same = memcmp(box.center, b.center, sizeof(box.center)) == 0
+        && memcmp(box.size, b.size, sizeof(box.size)) == 0
+        && same_params(box.nearer, b.nearer) && same_params(box.further, b.further)
+        && same_params(box.greater, b.greater);
+      report(same, 0, 0, k == 0 ? "box_digits" : "child");
+    }
+    take_flags();
+    ACJ r_lattice = reference_lattice(box);
+    ACJ r_lox = reference_loxodromic_sqrt(box);
+    ACJ r_parabolic = reference_parabolic(box);
+    SL2ACJ r_G = reference_G(box); int f_G = take_flags();
+    ACJ r_T = reference_T(box, 3, -2); int f_T = take_flags();
+    compare(r_lattice, 0, acj(box.cover.lattice), 0, "lattice", true);
+    compare(r_lox, 0, acj(box.cover.loxodromic_sqrt), 0, "loxodromic_sqrt",
+        true);
+    compare(r_parabolic, 0, acj(box.cover.parabolic), 0, "parabolic", true);
+    SL2ACJ a_G = construct_G(box.cover);
+    compare(r_G, f_G, a_G, take_flags(), "G", true);
+    ACJ a_T = construct_T(box.cover, 3, -2);
+    compare(r_T, f_T, a_T, take_flags(), "T", true);
+  }
+  end_check();
+}
+
+// Words
+
+// Whether the errors of x are finite. An infinite or NaN error, as on
+// boxes holding a zero of loxodromic_sqrt, bounds nothing.
+bool bounded(const SL2ACJ& x)
+{
+  return x.a.e <= DBL_MAX && x.b.e <= DBL_MAX && x.c.e <= DBL_MAX
+    && x.d.e <= DBL_MAX;
+}
+
+// A lower bound on |x - y|
+double distance_lb(const XComplex& x, const XComplex& y)
+{
+  return fmax(fabs(x.re - y.re), fabs(x.im - y.im));
+}
+
+// Whether x and y can bound the same jet. Their affine parts differ by at
+// most their errors over the box, and the largest difference there is
+// |x.f - y.f| + |x.f0 - y.f0| + |x.f1 - y.f1| + |x.f2 - y.f2|.
+bool overlap(const ACJ& x, const ACJ& y)
+{
+  double d = (distance_lb(x.f, y.f) + distance_lb(x.f0, y.f0))
+    + (distance_lb(x.f1, y.f1) + distance_lb(x.f2, y.f2));
+  return (1-8*EPS)*d <= (1+3*EPS)*(x.e+y.e);
+}
+
+bool overlap(const SL2ACJ& x, const SL2ACJ& y)
+{
+  return overlap(x.a, y.a) && overlap(x.b, y.b) && overlap(x.c, y.c)
+    && overlap(x.d, y.d);
+}
+
+// Each word on the boxes by construct_word() and context_word(), alone and
+// in batches of up to 2 * SIMD_LANES boxes, against the reference. Each box
+// of a batch must hold the flags it holds alone, also in a batch where one
+// lane holds flags and the others none.
+void check_words(const SimdOps& ops, const std::vector<std::string>& codes,
+    const std::vector<std::string>& words)
+{
+  char name[64];
+  snprintf(name, sizeof(name), "words %s", ops.name);
+  begin_check(name);
+  SimdOps saved = g_simd;
+  g_simd = ops;
+  std::vector<LeafContext> leaves(codes.size());
+  std::vector<SL2ACJ> refs(codes.size());
+  std::vector<int> ref_flags(codes.size());
+  std::vector<int> single_flags(codes.size());
+  std::vector<int> single_held(codes.size());
+  long mixed_batches = 0;
+  for (size_t w = 0; w < words.size(); ++w) {
+    const char* word = words[w].c_str();
+    int index = intern_word(word);
+    for (size_t i = 0; i < codes.size(); ++i) {
+      std::vector<char> code(codes[i].begin(), codes[i].end());
+      code.push_back('\0');
+      leaves[i].box = build_box(&code[0]);
+      reset_context(leaves[i]);
+      take_flags();
+      refs[i] = reference_word(leaves[i].box, word);
+      ref_flags[i] = take_flags();
+      SL2ACJ ops_matrix = construct_word(leaves[i], word);
+      compare(refs[i], ref_flags[i], ops_matrix, take_flags(), word, true);
+      reset_context(leaves[i]);
+      int held = 0;
+      SL2ACJ single = context_word(leaves[i], index, &held);
+      int f_single = take_flags() | held;
+      if (word_program(index)->num_steps == 0) {
+        compare(refs[i], ref_flags[i], single, f_single, word, true);
+      } else if (!bounded(refs[i]) || !bounded(single)) {
+        ++g_unbounded;
+      } else {
+        // The plan reorders the multiplications, see word.h
+        report(overlap(refs[i], single), 0, 0, word);
+      }
+      // Fresh caches, so the batch evaluates the word
+      reset_context(leaves[i]);
+      refs[i] = single;
+      single_flags[i] = f_single;
+      single_held[i] = held;
+    }
+    // A batch raises the flags of each of its boxes alone, all together
+    for (size_t first = 0; first < codes.size(); first += 2 * SIMD_LANES) {
+      size_t n = std::min(codes.size() - first, size_t(2 * SIMD_LANES));
+      int union_flags = 0;
+      for (size_t i = first; i < first + n; ++i) {
+        leaves[i].batch = &leaves[first];
+        leaves[i].batch_size = n;
+        union_flags |= single_flags[i];
+      }
+      int held = 0;
+      for (size_t i = first; i < first + n; ++i) {
+        int box_held = 0;
+        SL2ACJ batched = context_word(leaves[i], index, &box_held);
+        compare(refs[i], single_held[i], batched, box_held, "batch");
+        held |= box_held;
+      }
+      report(true, union_flags, take_flags() | held, "batch flags");
+      for (size_t i = first; i < first + n; ++i) {
+        reset_context(leaves[i]);
+      }
+    }
+    // A box holding flags first, so the batch is evaluated from its lane
+    std::vector<LeafContext*> mixed;
+    for (size_t i = 0; i < codes.size() && mixed.empty(); ++i) {
+      if (single_held[i]) {
+        mixed.push_back(&leaves[i]);
+      }
+    }
+    for (size_t i = 0; i < codes.size() && !mixed.empty()
+        && mixed.size() < SIMD_LANES; ++i) {
+      if (!single_held[i]) {
+        mixed.push_back(&leaves[i]);
+      }
+    }
+    if (mixed.size() > 1) {
+      ++mixed_batches;
+      std::vector<LeafContext> batch(mixed.size());
+      for (size_t j = 0; j < mixed.size(); ++j) {
+        batch[j].box = mixed[j]->box;
+        reset_context(batch[j]);
+        batch[j].batch = &batch[0];
+        batch[j].batch_size = batch.size();
+      }
+      for (size_t j = 0; j < batch.size(); ++j) {
+        size_t i = mixed[j] - &leaves[0];
+        int box_held = 0;
+        SL2ACJ batched = context_word(batch[j], index, &box_held);
+        compare(refs[i], single_held[i], batched, box_held, "mixed batch");
+      }
+      take_flags();
+    }
+  }
+  // The word overflowing on the boxes far from 0 gives one, see main()
+  report(mixed_batches > 0, 0, 0, "mixed batches");
+  g_simd = saved;
+  end_check();
+}
+
+// Whether the plans of the words at x and y use a block in common
+bool share_block(int x, int y)
+{
+  const WordProgram* px = word_program(x);
+  const WordProgram* py = word_program(y);
+  for (size_t i = 0; i < px->num_steps; ++i) {
+    for (size_t j = 0; j < py->num_steps; ++j) {
+      if (px->plan[i].kind == WORD_BLOCK && py->plan[j].kind == WORD_BLOCK
+          && px->plan[i].M == py->plan[j].M) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+// The matrix given to the last test by word_holds()
+SL2ACJ g_tested;
+
+bool always_holds(LeafContext& ctx, const SL2ACJ& w)
+{
+  g_tested = w;
+  return true;
+}
+
+bool never_holds(LeafContext& ctx, const SL2ACJ& w)
+{
+  g_tested = w;
+  return false;
+}
+
+// Words whose plans share a block, each after the other on a leaf, so the
+// second reuses the blocks of the first, against each alone. The matrix and
+// held flags must be those of a fresh leaf, and word_holds() must test the
+// plan's matrix, then the ops' matrix with the flags of the ops alone.
+void check_shared_words(const std::vector<std::string>& codes,
+    const std::vector<std::string>& words)
+{
+  begin_check("shared blocks");
+  std::vector<int> index(words.size());
+  long shared_steps = 0;
+  for (size_t w = 0; w < words.size(); ++w) {
+    index[w] = intern_word(words[w].c_str());
+  }
+  for (size_t w = 0; w < words.size(); ++w) {
+    const WordProgram* program = word_program(index[w]);
+    for (size_t i = 0; i < program->num_steps; ++i) {
+      shared_steps += program->plan[i].kind == WORD_BLOCK
+        && program->plan[i].N == 1;
+    }
+  }
+  report(shared_steps > 0, 0, 0, "shared steps");
+  LeafContext ctx;
+  for (size_t i = 0; i < codes.size(); ++i) {
+    std::vector<char> code(codes[i].begin(), codes[i].end());
+    code.push_back('\0');
+    ctx.box = build_box(&code[0]);
+    for (size_t x = 0; x < words.size(); ++x) {
+      for (size_t y = 0; y < words.size(); ++y) {
+        if (x == y || !share_block(index[x], index[y])) {
+          continue;
+        }
+        const char* word = words[y].c_str();
+        reset_context(ctx);
+        int fresh_held = 0;
+        SL2ACJ fresh = context_word(ctx, index[y], &fresh_held);
+        reset_context(ctx);
+        int first_held = 0;
+        context_word(ctx, index[x], &first_held);
+        int held = 0;
+        SL2ACJ after = context_word(ctx, index[y], &held);
+        compare(fresh, fresh_held, after, held, word);
+        take_flags();
+        word_holds(ctx, word, always_holds);
+        compare(fresh, fresh_held, g_tested, take_flags(), word);
+        reset_context(ctx);
+        SL2ACJ ops_matrix = construct_word(ctx, word);
+        int ops_flags = take_flags();
+        reset_context(ctx);
+        word_holds(ctx, word, never_holds);
+        compare(ops_matrix, ops_flags, g_tested, take_flags(), word);
+      }
+    }
+  }
+  end_check();
+}
+
+// Words of the conditions of a text tree, as in K(word) or T(word,word),
+// at most max_words
+void read_words(const char* path, std::set<std::string>& words, size_t max_words)
+{
+  FILE* fp = fopen(path, "r");
+  if (fp == NULL) {
+    fprintf(stderr, "Fatal: cannot open %s\n", path);
+    exit(1);
+  }
+  char line[MAX_CODE_LEN];
+  while (words.size() < max_words && fgets(line, sizeof(line), fp)) {
+    char* start = strchr(line, '(');
+    char* end = start ? strchr(start, ')') : NULL;
+    if (end == NULL) {
+      continue;
+    }
+    *end = '\0';
+    for (char* word = strtok(start + 1, ","); word; word = strtok(NULL, ",")) {
+      if (strspn(word, "gGmMnN") == strlen(word)) {
+        words.insert(word);
+      }
+    }
+  }
+  fclose(fp);
+}
+
+int main(int argc, char** argv)
+{
+  long n = 20000;
+  long seed = 1;
+  size_t max_words = 64;
+  bool bad = false;
+  int opt;
+  while ((opt = getopt(argc, argv, "n:s:w:")) != -1) {
+    if (opt == 'n') {
+      n = atol(optarg);
+    } else if (opt == 's') {
+      seed = atol(optarg);
+    } else if (opt == 'w') {
+      max_words = atol(optarg);
+    } else {
+      bad = true;
+    }
+  }
+  if (bad || n <= 0) {
+    fprintf(stderr, "Usage: %s [-n cases] [-s seed] [-w max_words] [text_tree ...]\n",
+        argv[0]);
+    exit(1);
+  }
+  srand48(seed);
+
+  // Blocks repeat in some, in a row, apart or in two words, so they get
+  // plans, see word.h
+  std::set<std::string> word_set;
+  const char* builtin[] = { "G", "g", "gNg", "GnGm", "gNgMmG", "GNNgmmGMn",
+    "gggg", "GNGNGNGN", "gNgNgNgNgN", "MgnMgnMgnG", "GNgnGmGNgnG",
+    "GgNgGmm", "ggNgGn" };
+  for (size_t i = 0; i < sizeof(builtin) / sizeof(builtin[0]); ++i) {
+    word_set.insert(builtin[i]);
+  }
+  // Overflows on the boxes far from 0, so batches have flags to compare
+  std::string overflow;
+  for (int i = 0; i < 160; ++i) {
+    overflow += "Gn";
+  }
+  word_set.insert(overflow);
+  for (int i = optind; i < argc; ++i) {
+    read_words(argv[i], word_set, word_set.size() + max_words);
+  }
+  std::vector<std::string> words(word_set.begin(), word_set.end());
+  std::vector<std::string> codes = input_boxcodes(n / 500 + 8);
+
+  const SimdOps* levels[3] = { &g_scalar_ops, &g_sse2_ops, &g_avx2_ops };
+  int num_levels = init_simd("avx2") ? 3 : 2;
+  for (int i = 0; i < num_levels; ++i) {
+    check_kernels(*levels[i], n);
+    check_lanes(*levels[i], n / 4);
+  }
+  check_jets<JET_F0, JET_F1>("jets f0 f1", n);
+  check_jets<JET_F1, JET_F2>("jets f1 f2", n);
+  check_jets<JET_F2, JET_F2>("jets f2 f2", n);
+  check_jets<JET_F0, 0>("jets f0 constant", n);
+  check_jets<0, JET_F2>("jets constant f2", n);
+  check_jets<JET_F0 | JET_F1, JET_F2>("jets f0f1 f2", n);
+  check_jets<JET_FULL, JET_F1>("jets full f1", n);
+  check_jets<JET_F1, JET_FULL>("jets f1 full", n);
+  check_boxes(codes);
+  for (int i = 0; i < num_levels; ++i) {
+    check_words(*levels[i], codes, words);
+  }
+  check_shared_words(codes, words);
+
+  if (g_failed_checks > 0) {
+    printf("Error --  %ld checks differ from the reference arithmetic!\n",
+        g_failed_checks);
+    exit(-1);
+  }
+  printf("All alternatives match the reference arithmetic.\n");
+  exit(0);
+}
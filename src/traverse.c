@@ -0,0 +1,232 @@
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#include "checkpoint.h"
+#include "elimination.h"
+#include "telemetry.h"
+#include "traverse.h"
+
+// Level l > 0 of a boxcode halves dimension (l - 1) % 6. The digits of
+// that dimension after level l are kept at index l + 5 of the stack, and
+// indices 0 to 5 hold the digits of the initial box, as levels -5 to 0.
+// The digits of a level are computed from those of the level 6 above it
+// with the operations of child(), so a box is bit-identical to build_box().
+typedef struct {
+  double center[MAX_DEPTH + 6];
+  double size[MAX_DEPTH + 6];
+} DigitStack;
+
+void set_level(DigitStack* s, size_t level, int dir)
+{
+  size_t i = level + 5;
+  s->size[i] = s->size[i - 6] * 0.5;
+  s->center[i] = s->center[i - 6] + (2 * dir - 1) * s->size[i];
+}
+
+BoxDigits level_digits(const DigitStack* s, size_t depth)
+{
+  BoxDigits digits;
+  for (int k = 0; k < 6; ++k) {
+    // The deepest level at most depth that halves dimension k
+    long level = depth - ((depth + 11 - k) % 6);
+    digits.center_digits[k] = s->center[level + 5];
+    digits.size_digits[k] = s->size[level + 5];
+  }
+  digits.pos = depth % 6;
+  return digits;
+}
+
+// Leaves waiting to be checked. Their digits are stored by dimension, and
+// their boxcodes and lines in one arena of text.
+typedef struct {
+  size_t num_leaves;
+  double center[6][LEAF_BATCH];
+  double size[6][LEAF_BATCH];
+  int code_index[LEAF_BATCH];
+  size_t where[LEAF_BATCH]; // offsets into text
+  size_t code[LEAF_BATCH];
+  size_t depth[LEAF_BATCH];
+  size_t order[LEAF_BATCH];
+  size_t text_size;
+  char text[LEAF_BATCH_TEXT];
+} LeafBatch;
+
+// Reused by every walk on a thread
+__thread LeafBatch* t_batch = 0;
+__thread LeafContext* t_contexts = 0;
+
+// By condition code, then by word, then in depth-first order
+bool leaf_before(const LeafBatch* batch, size_t a, size_t b)
+{
+  if (batch->code_index[a] != batch->code_index[b]) {
+    return batch->code_index[a] < batch->code_index[b];
+  }
+  int words = strcmp(batch->text + batch->code[a], batch->text + batch->code[b]);
+  return words != 0 ? words < 0 : a < b;
+}
+
+char* add_text(LeafBatch* batch, const char* text, size_t* offset)
+{
+  *offset = batch->text_size;
+  char* copy = batch->text + batch->text_size;
+  strcpy(copy, text);
+  batch->text_size += strlen(text) + 1;
+  return copy;
+}
+
+void add_leaf(LeafBatch* batch, const DigitStack* s, size_t depth,
+    const char* where, const char* code)
+{
+  size_t i = batch->num_leaves++;
+  BoxDigits digits = level_digits(s, depth);
+  for (int k = 0; k < 6; ++k) {
+    batch->center[k][i] = digits.center_digits[k];
+    batch->size[k][i] = digits.size_digits[k];
+  }
+  batch->code_index[i] = leaf_code_index(code[0]);
+  batch->depth[i] = depth;
+  add_text(batch, where, &batch->where[i]);
+  add_text(batch, code, &batch->code[i]);
+  batch->order[i] = i;
+}
+
+bool batch_full(const LeafBatch* batch)
+{
+  return batch->num_leaves == LEAF_BATCH
+    || batch->text_size + MAX_DEPTH + MAX_CODE_LEN > LEAF_BATCH_TEXT;
+}
+
+// Checks the leaves of the batch one condition code at a time
+void flush_batch(LeafBatch* batch, const LeafFunc* kernels,
+    TelemetryCounters* counters)
+{
+  if (!t_contexts) {
+    t_contexts = new LeafContext[WORD_BATCH];
+  }
+  LeafContext* contexts = t_contexts;
+  std::sort(batch->order, batch->order + batch->num_leaves,
+      [batch](size_t a, size_t b) { return leaf_before(batch, a, b); });
+  size_t i = 0;
+  while (i < batch->num_leaves) {
+    int index = batch->code_index[batch->order[i]];
+    LeafFunc kernel = kernels[index];
+    double started = counters ? telemetry_clock() : 0;
+    size_t first = i;
+    size_t end = i;
+    while (end < batch->num_leaves && batch->code_index[batch->order[end]] == index) {
+      ++end;
+    }
+    while (i < end) {
+      // Kernels rewrite the lines, so find the leaves sharing one first
+      const char* line = batch->text + batch->code[batch->order[i]];
+      size_t n = 1;
+      while (n < WORD_BATCH && i + n < end
+          && strcmp(line, batch->text + batch->code[batch->order[i + n]]) == 0) {
+        ++n;
+      }
+      for (size_t j = 0; j < n; ++j) {
+        size_t leaf = batch->order[i + j];
+        BoxDigits digits;
+        for (int k = 0; k < 6; ++k) {
+          digits.center_digits[k] = batch->center[k][leaf];
+          digits.size_digits[k] = batch->size[k][leaf];
+        }
+        digits.pos = batch->depth[leaf] % 6;
+        LeafContext& ctx = contexts[j];
+        ctx.box = build_box(digits);
+        reset_context(ctx);
+        ctx.batch = contexts;
+        ctx.batch_size = n;
+      }
+      for (size_t j = 0; j < n; ++j) {
+        size_t leaf = batch->order[i + j];
+        kernel(contexts[j], batch->text + batch->where[leaf],
+            batch->text + batch->code[leaf]);
+      }
+      i += n;
+    }
+    if (counters) {
+      double seconds = counters->check_seconds + (telemetry_clock() - started);
+      __atomic_store(&counters->check_seconds, &seconds, __ATOMIC_RELAXED);
+      bump(&counters->leaves[index], i - first);
+      __atomic_store_n(&counters->depth, batch->depth[batch->order[i - 1]],
+          __ATOMIC_RELAXED);
+    }
+  }
+  batch->num_leaves = 0;
+  batch->text_size = 0;
+}
+
+void walk_tree(TreeReader* tree, char* where, const LeafFunc* kernels,
+    ProgressFunc progress, size_t* count_ptr, bool write_checkpoints)
+{
+  size_t start = strlen(where);
+  check(start < MAX_DEPTH, where);
+  DigitStack s;
+  BoxDigits initial;
+  for (int k = 0; k < 6; ++k) {
+    s.center[k] = initial.center_digits[k];
+    s.size[k] = initial.size_digits[k];
+  }
+  for (size_t level = 1; level <= start; ++level) {
+    set_level(&s, level, where[level - 1] == '1');
+  }
+  if (!t_batch) {
+    t_batch = (LeafBatch*) malloc(sizeof(LeafBatch));
+    t_batch->num_leaves = 0;
+    t_batch->text_size = 0;
+  }
+  LeafBatch* batch = t_batch;
+  size_t depth = start;
+  char code[MAX_CODE_LEN];
+  TelemetryCounters* counters = g_telemetry ? telemetry_counters() : 0;
+  while (true) {
+    if (!read_node(tree, code, MAX_CODE_LEN)) {
+      code[0] = '\0';
+    }
+    if (counters) {
+      bump(&counters->nodes, 1);
+      bump(&counters->bytes, strlen(code));
+    }
+    if (code[0] == 'X') {
+      check(depth + 1 < MAX_DEPTH, where);
+      where[depth] = '0';
+      where[++depth] = '\0';
+      set_level(&s, depth, 0);
+      continue;
+    }
+    // We fail on unknown codes, guaranteeing completes on the tree
+    int index = leaf_code_index(code[0]);
+    if (index < 0 || !kernels[index]) {
+      check(false, where);
+    } else if (!before_checkpoint(where)) { // else checked by an earlier run
+      reach_checkpoint(where, *count_ptr);
+      // A checkpoint may only name a leaf once those before it are checked
+      if (write_checkpoints && checkpoint_due()) {
+        flush_batch(batch, kernels, counters);
+        write_checkpoint(where, *count_ptr, fetestexcept(CHECKPOINT_FP_FLAGS));
+      }
+      add_leaf(batch, &s, depth, where, code);
+      if (batch_full(batch)) {
+        flush_batch(batch, kernels, counters);
+      }
+    }
+    size_t count = __atomic_add_fetch(count_ptr, 1, __ATOMIC_RELAXED);
+    if (progress && count % (1 << 18) == 0) {
+      progress(count);
+    }
+    // Move up past finished right children, then over to the right
+    while (depth > start && where[depth - 1] == '1') {
+      --depth;
+    }
+    if (depth == start) {
+      where[start] = '\0';
+      flush_batch(batch, kernels, counters);
+      return;
+    }
+    where[depth - 1] = '1';
+    where[depth] = '\0';
+    set_level(&s, depth, 1);
+  }
+}
@@ -0,0 +1,31 @@
+#ifndef _traverse_h_
+#define _traverse_h_
+#include "elimination.h"
+#include "tree.h"
+
+// Checks one leaf given its context and its line, parentheses included
+typedef void (*LeafFunc)(LeafContext& ctx, char* where, char* code);
+
+// Leaves are checked in batches of up to LEAF_BATCH, and up to WORD_BATCH
+// leaves with the same line share their word evaluations
+#define LEAF_BATCH 4096
+#define LEAF_BATCH_TEXT (1 << 20)
+#define WORD_BATCH 16
+
+// Called with the leaf count every 2^18 leaves
+typedef void (*ProgressFunc)(size_t count);
+
+// Walks the subtree at where in depth-first order without recursion. The
+// walk keeps one line buffer and, per level, the digits of the dimension
+// that level halves, see set_level(). Leaves are buffered and each batch
+// is checked grouped by condition code, and by word within a code, with
+// kernels[i] checking the leaves of code tree_leaf_codes[i]. A missing
+// kernel fails the leaf. Leaves before the checkpoint being resumed are
+// counted but not checked, and checkpoints are written between batches if
+// write_checkpoints is set. The leaves are added to *count_ptr atomically,
+// so one count may be shared by several walks. All leaves are checked by
+// the time it returns, with where holding its initial boxcode again.
+void walk_tree(TreeReader* tree, char* where, const LeafFunc* kernels,
+    ProgressFunc progress, size_t* count_ptr, bool write_checkpoints);
+
+#endif // _traverse_h_
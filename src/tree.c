@@ -0,0 +1,395 @@
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "boxfile.h"
+#include "tree.h"
+
+const char tree_leaf_codes[16] = {
+  '0', '1', '2', '3', '4', '5', '6', '9',
+  'K', 'S', 'V', 'Q', 'L', 'E', 'T', 'I'
+};
+
+int leaf_code_index(char code)
+{
+  for (int i = 0; i < 16; ++i) {
+    if (tree_leaf_codes[i] == code) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+bool lettered_code(char code)
+{
+  return leaf_code_index(code) > 7;
+}
+
+void open_tree_buffer(TreeReader* tree, char* data, size_t size)
+{
+  memset(tree, 0, sizeof(TreeReader));
+  tree->stream = fmemopen(data, size, "r");
+  if (!tree->stream) {
+    fprintf(stderr, "Fatal: failed to open tree buffer\n");
+    exit(2);
+  }
+}
+
+void corrupt_tree(const char* location, const char* reason)
+{
+  fprintf(stderr, "Fatal: tree file %s is corrupt (%s)\n", location, reason);
+  exit(7);
+}
+
+void open_tree(TreeReader* tree, const char* location)
+{
+  memset(tree, 0, sizeof(TreeReader));
+  if (!location) {
+    tree->stream = stdin;
+    return;
+  }
+  int fd = open(location, O_RDONLY);
+  struct stat sb;
+  if (fd < 0 || fstat(fd, &sb) != 0) {
+    fprintf(stderr, "Fatal: failed to open tree file %s\n", location);
+    exit(2);
+  }
+  if (S_ISDIR(sb.st_mode)) {
+    close(fd);
+    open_box_files(location);
+    tree->directory = true;
+    tree->boxcode = (char*) calloc(MAX_BOXCODE_LEN, 1);
+    tree->frames = (HoleFrame*) malloc(MAX_BOXCODE_LEN * sizeof(HoleFrame));
+    return;
+  }
+  if ((size_t) sb.st_size < sizeof(TreeHeader)) {
+    corrupt_tree(location, "truncated header");
+  }
+  void* map = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    fprintf(stderr, "Fatal: failed to map tree file %s\n", location);
+    exit(2);
+  }
+  madvise(map, sb.st_size, MADV_SEQUENTIAL);
+  tree->map = (const unsigned char*) map;
+  tree->map_size = sb.st_size;
+  tree->header = (const TreeHeader*) map;
+
+  const TreeHeader* h = tree->header;
+  if (memcmp(h->magic, TREE_MAGIC, sizeof(h->magic)) != 0) {
+    corrupt_tree(location, "bad magic");
+  }
+  if (h->version != TREE_VERSION) {
+    corrupt_tree(location, "unsupported version");
+  }
+  if (h->file_size != tree->map_size
+      || h->word_id_width < 1 || h->word_id_width > 4
+      || h->structure_offset + (h->num_nodes + 7) / 8 > h->codes_offset
+      || h->codes_offset + (h->num_leaves + 1) / 2 > h->word_refs_offset
+      || h->word_refs_offset + h->num_word_refs * h->word_id_width
+            > h->dictionary_offset
+      || h->dictionary_offset % sizeof(uint64_t) != 0
+      || h->dictionary_offset + (h->num_words + 1) * sizeof(uint64_t)
+            > tree->map_size) {
+    corrupt_tree(location, "bad section layout");
+  }
+  tree->dictionary = (const uint64_t*) (tree->map + h->dictionary_offset);
+  uint64_t blob = h->dictionary_offset + (h->num_words + 1) * sizeof(uint64_t);
+  if (blob + tree->dictionary[h->num_words] > tree->map_size) {
+    corrupt_tree(location, "bad dictionary");
+  }
+}
+
+bool branch_node(const TreeReader* tree, uint64_t n)
+{
+  return (tree->map[tree->header->structure_offset + n / 8] >> (n % 8)) & 1;
+}
+
+char leaf_code(const TreeReader* tree, uint64_t l)
+{
+  int index = (tree->map[tree->header->codes_offset + l / 2] >> (4 * (l % 2)));
+  return tree_leaf_codes[index & 0xF];
+}
+
+void push_hole_file(TreeReader* tree, FILE* fp)
+{
+  HoleFrame* f = &tree->frames[tree->num_frames++];
+  f->fp = fp;
+  f->box_depth = strlen(tree->boxcode);
+  f->depth = 0;
+}
+
+// Reads the next line of the open hole files, descending into hole files
+// and closing them once their subtree is complete
+bool read_directory_node(TreeReader* tree, char* code, size_t len)
+{
+  while (tree->num_frames > 0) {
+    HoleFrame* f = &tree->frames[tree->num_frames - 1];
+    if (!fgets(code, len, f->fp)) {
+      if (tree->num_frames == 1) {
+        fprintf(stderr, "Fatal: incomplete tree\n");
+        exit(3);
+      }
+      fprintf(stderr, "Fatal: hole file incomplete at %s\n", tree->boxcode);
+      exit(5);
+    }
+    // Open HOLE file
+    if (code[0] == 'H') {
+      if (f->depth == 0) {
+        fprintf(stderr, "Fatal: recursive hole file at %s\n", tree->boxcode);
+        exit(4);
+      }
+      FILE* fp = open_box(tree->boxcode);
+      if (!fp) {
+        fprintf(stderr, "Fatal: failed to open hole file at %s\n", tree->boxcode);
+        exit(2);
+      }
+      push_hole_file(tree, fp);
+      continue;
+    }
+    // A complete hole file is a finished leaf of the file that holds it
+    char node = code[0];
+    while (advance_boxcode(tree->boxcode, f->box_depth, &f->depth, node)) {
+      fclose(f->fp);
+      if (--tree->num_frames == 0) {
+        break;
+      }
+      f = &tree->frames[tree->num_frames - 1];
+      node = 'H';
+    }
+    return true;
+  }
+  return false;
+}
+
+// Skips the subtree at the next node. Hole files below it are never opened,
+// an H line counts as a leaf of the file that holds it.
+void skip_directory_node(TreeReader* tree)
+{
+  char code[MAX_BOXCODE_LEN];
+  size_t open_nodes = 1;
+  while (open_nodes > 0 && tree->num_frames > 0) {
+    HoleFrame* f = &tree->frames[tree->num_frames - 1];
+    if (!fgets(code, sizeof(code), f->fp)) {
+      fprintf(stderr, "Fatal: hole file incomplete at %s\n", tree->boxcode);
+      exit(5);
+    }
+    if (code[0] == 'H' && f->depth == 0) {
+      fprintf(stderr, "Fatal: recursive hole file at %s\n", tree->boxcode);
+      exit(4);
+    }
+    if (code[0] == 'X') {
+      ++open_nodes;
+    } else {
+      --open_nodes;
+    }
+    char node = code[0];
+    while (advance_boxcode(tree->boxcode, f->box_depth, &f->depth, node)) {
+      fclose(f->fp);
+      if (--tree->num_frames == 0) {
+        break;
+      }
+      f = &tree->frames[tree->num_frames - 1];
+      node = 'H';
+    }
+  }
+}
+
+bool seek_directory(TreeReader* tree, const char* boxcode)
+{
+  IndexEntry start;
+  memset(&start, 0, sizeof(start));
+  if (!find_index_entry(boxcode, &start)) {
+    start.boxcode = strdup("");
+    start.file = strdup("");
+  }
+  start_prefetch(tree->prefetch_threads, tree->prefetch_bytes, start.file);
+  FILE* fp = open_box(start.file);
+  if (!fp) {
+    fprintf(stderr, "Fatal: failed to open root file\n");
+    exit(2);
+  }
+  skip_to(fp, start.offset);
+  strcpy(tree->boxcode, start.boxcode);
+  push_hole_file(tree, fp);
+  tree->opened = true;
+  free(start.boxcode);
+  free(start.file);
+
+  // Walk from the indexed ancestor, nodes come in lexicographic order
+  char code[MAX_BOXCODE_LEN];
+  while (strcmp(tree->boxcode, boxcode) != 0) {
+    if (tree->num_frames == 0 || strcmp(tree->boxcode, boxcode) > 0
+        || !read_directory_node(tree, code, sizeof(code))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool read_node(TreeReader* tree, char* code, size_t len)
+{
+  if (tree->stream) {
+    return fgets(code, len, tree->stream) != NULL;
+  }
+  if (tree->directory) {
+    if (!tree->opened && !seek_directory(tree, "")) {
+      return false;
+    }
+    return read_directory_node(tree, code, len);
+  }
+  const TreeHeader* h = tree->header;
+  if (tree->node >= h->num_nodes) {
+    return false;
+  }
+  if (branch_node(tree, tree->node++)) {
+    strcpy(code, "X\n");
+    return true;
+  }
+  if (tree->leaf >= h->num_leaves) {
+    return false;
+  }
+  char c = leaf_code(tree, tree->leaf++);
+  if (!lettered_code(c)) {
+    code[0] = c;
+    code[1] = '\n';
+    code[2] = '\0';
+    return true;
+  }
+  if (tree->word_ref >= h->num_word_refs) {
+    return false;
+  }
+  const unsigned char* ref = tree->map + h->word_refs_offset
+    + tree->word_ref++ * h->word_id_width;
+  uint64_t id = 0;
+  for (uint32_t i = 0; i < h->word_id_width; ++i) {
+    id |= ((uint64_t) ref[i]) << (8 * i);
+  }
+  if (id >= h->num_words) {
+    return false;
+  }
+  const char* blob = (const char*) (tree->dictionary + h->num_words + 1);
+  uint64_t start = tree->dictionary[id];
+  uint64_t end = tree->dictionary[id + 1];
+  // Only the last offset is checked against the file, see open_tree()
+  if (start > end || end > tree->dictionary[h->num_words]
+      || end - start + 5 > len) {
+    return false;
+  }
+  code[0] = c;
+  code[1] = '(';
+  memcpy(code + 2, blob + start, end - start);
+  strcpy(code + 2 + (end - start), ")\n");
+  return true;
+}
+
+// Skips the subtree at the current node
+void skip_subtree(TreeReader* tree)
+{
+  const TreeHeader* h = tree->header;
+  uint64_t open_nodes = 1;
+  while (open_nodes > 0 && tree->node < h->num_nodes) {
+    if (branch_node(tree, tree->node++)) {
+      ++open_nodes;
+    } else {
+      --open_nodes;
+      if (tree->leaf < h->num_leaves && lettered_code(leaf_code(tree, tree->leaf++))) {
+        ++tree->word_ref;
+      }
+    }
+  }
+}
+
+bool seek_tree(TreeReader* tree, const char* boxcode)
+{
+  if (tree->stream) {
+    return true;
+  }
+  if (tree->directory) {
+    return seek_directory(tree, boxcode);
+  }
+  for (const char* c = boxcode; *c != '\0'; ++c) {
+    if (tree->node >= tree->header->num_nodes || !branch_node(tree, tree->node)) {
+      return false;
+    }
+    ++tree->node; // enter the left child
+    if (*c == '1') {
+      skip_subtree(tree);
+    }
+  }
+  return true;
+}
+
+void skip_node(TreeReader* tree)
+{
+  if (tree->stream) {
+    char code[MAX_BOXCODE_LEN];
+    size_t open_nodes = 1;
+    while (open_nodes > 0 && fgets(code, sizeof(code), tree->stream)) {
+      if (code[0] == 'X') {
+        ++open_nodes;
+      } else {
+        --open_nodes;
+      }
+    }
+    return;
+  }
+  if (tree->directory) {
+    if (!tree->opened && !seek_directory(tree, "")) {
+      return;
+    }
+    skip_directory_node(tree);
+    return;
+  }
+  skip_subtree(tree);
+}
+
+size_t tree_leaves(const TreeReader* tree, const char* boxcode)
+{
+  if (tree->directory) {
+    IndexEntry entry;
+    memset(&entry, 0, sizeof(entry));
+    bool exact = find_index_entry(boxcode, &entry) && strcmp(entry.boxcode, boxcode) == 0;
+    free(entry.boxcode);
+    free(entry.file);
+    return exact ? entry.leaves : 0;
+  }
+  if (!tree->map) {
+    return 0;
+  }
+  if (tree->node == 0) {
+    return tree->header->num_leaves;
+  }
+  // One more leaf than branch in the subtree at the current node
+  uint64_t open_nodes = 1;
+  size_t leaves = 0;
+  for (uint64_t n = tree->node; open_nodes > 0 && n < tree->header->num_nodes; ++n) {
+    if (branch_node(tree, n)) {
+      ++open_nodes;
+    } else {
+      --open_nodes;
+      ++leaves;
+    }
+  }
+  return leaves;
+}
+
+void close_tree(TreeReader* tree)
+{
+  if (tree->stream && tree->stream != stdin) {
+    fclose(tree->stream);
+  }
+  if (tree->map) {
+    munmap((void*) tree->map, tree->map_size);
+  }
+  while (tree->num_frames > 0) {
+    fclose(tree->frames[--tree->num_frames].fp);
+  }
+  free(tree->boxcode);
+  free(tree->frames);
+  memset(tree, 0, sizeof(TreeReader));
+}
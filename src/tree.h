@@ -0,0 +1,99 @@
+#ifndef _tree_h_
+#define _tree_h_
+#include <stdint.h>
+#include <stdio.h>
+
+// Packed binary tree format
+//
+// The file is a header followed by four sections, all in depth-first order:
+//    structure  - one bit per node, 1 for an X (branch) and 0 for a leaf
+//    codes      - one nibble per leaf, an index into tree_leaf_codes
+//    word refs  - for every lettered leaf, a little-endian dictionary id
+//                 of word_id_width bytes
+//    dictionary - num_words + 1 uint64 offsets into a blob of strings
+// A dictionary entry is the text between the parentheses of a leaf, so
+// K(gNG) refers to "gNG" and T(gN,Gn) to "gN,Gn". Bits and nibbles are
+// filled from the least significant end of each byte.
+
+#define TREE_MAGIC "VSLTREE1"
+#define TREE_VERSION 1
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t word_id_width;
+  uint64_t num_nodes;
+  uint64_t num_leaves;
+  uint64_t num_word_refs;
+  uint64_t num_words;
+  uint64_t structure_offset;
+  uint64_t codes_offset;
+  uint64_t word_refs_offset;
+  uint64_t dictionary_offset;
+  uint64_t file_size;
+} TreeHeader;
+
+// Condition codes that fit in a nibble. Lettered codes carry a word list.
+extern const char tree_leaf_codes[16];
+
+int leaf_code_index(char code);
+
+bool lettered_code(char code);
+
+// An open hole file of a tree directory, see boxfile.h
+typedef struct {
+  FILE* fp;
+  size_t box_depth;
+  size_t depth;
+} HoleFrame;
+
+// Reads nodes one line at a time, from a text stream in rootcat format,
+// from a memory-mapped binary tree or by walking a tree directory.
+typedef struct {
+  FILE* stream;
+  const unsigned char* map;
+  size_t map_size;
+  const TreeHeader* header;
+  const uint64_t* dictionary;
+  uint64_t node;
+  uint64_t leaf;
+  uint64_t word_ref;
+  bool directory;
+  bool opened;
+  char* boxcode;
+  HoleFrame* frames;
+  size_t num_frames;
+  int prefetch_threads; // for a tree directory, see start_prefetch()
+  size_t prefetch_bytes;
+} TreeReader;
+
+// Opens location as a tree directory or a binary tree, or reads text from
+// stdin if NULL. Hole files of a directory are not prefetched unless the
+// caller sets prefetch_threads and prefetch_bytes before the first read.
+void open_tree(TreeReader* tree, const char* location);
+
+// Reads text in rootcat format from a buffer of size bytes
+void open_tree_buffer(TreeReader* tree, char* data, size_t size);
+
+// Fills code with the next node as rootcat would print it, including the
+// trailing newline. Returns false when the tree is exhausted.
+bool read_node(TreeReader* tree, char* code, size_t len);
+
+// Moves the reader to the subtree at boxcode. A tree directory starts from
+// the deepest ancestor in its tree.idx, and a binary tree skips the
+// structure bits of the siblings along the way. A text stream is assumed to
+// already start at boxcode. Returns false if boxcode is not a node.
+bool seek_tree(TreeReader* tree, const char* boxcode);
+
+// The number of leaves of the subtree at boxcode, once seek_tree() has
+// moved there, from the header or structure bits of a binary tree or from
+// the tree.idx of a tree directory. Returns 0 if it is not known.
+size_t tree_leaves(const TreeReader* tree, const char* boxcode);
+
+// Skips the next node and its subtree. In a tree directory the hole files
+// of the subtree are not opened.
+void skip_node(TreeReader* tree);
+
+void close_tree(TreeReader* tree);
+
+#endif // _tree_h_
@@ -0,0 +1,193 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "boxfile.h"
+#include "tree.h"
+
+#define MAX_BUF 1024
+
+// Converts a tree directory, or the depth-first text tree printed by
+// rootcat, into the packed binary format described in tree.h. Sections
+// are spooled to temporary files since the full tree does not comfortably
+// fit in memory.
+
+FILE* spool()
+{
+  FILE* fp = tmpfile();
+  if (!fp) {
+    fprintf(stderr, "Fatal: failed to create temporary file\n");
+    exit(2);
+  }
+  return fp;
+}
+
+void put_bits(FILE* fp, unsigned char* byte, uint64_t count, int bits, int value)
+{
+  uint64_t per_byte = 8 / bits;
+  *byte |= value << (bits * (count % per_byte));
+  if (count % per_byte == per_byte - 1) {
+    fputc(*byte, fp);
+    *byte = 0;
+  }
+}
+
+void flush_bits(FILE* fp, unsigned char* byte, uint64_t count, int bits)
+{
+  if (count % (8 / bits) != 0) {
+    fputc(*byte, fp);
+  }
+}
+
+void copy_section(FILE* out, FILE* in, uint64_t offset)
+{
+  char buf[1 << 16];
+  size_t n;
+  fseek(out, offset, SEEK_SET);
+  rewind(in);
+  while ((n = fread(buf, 1, sizeof(buf), in)) > 0) {
+    fwrite(buf, 1, n, out);
+  }
+  fclose(in);
+}
+
+uint64_t align(uint64_t offset)
+{
+  return (offset + 7) & ~((uint64_t) 7);
+}
+
+int main(int argc, char** argv)
+{
+  if (argc != 2 && argc != 3) {
+    fprintf(stderr, "Usage: treepack [tree_location] tree_file < data\n");
+    exit(1);
+  }
+  const char* out_name = argv[argc - 1];
+  TreeReader tree;
+  open_tree(&tree, argc == 3 ? argv[1] : NULL);
+  tree.prefetch_threads = sysconf(_SC_NPROCESSORS_ONLN) / 2;
+  tree.prefetch_bytes = PREFETCH_BYTES;
+
+  FILE* structure = spool();
+  FILE* codes = spool();
+  FILE* refs = spool();
+  unsigned char structure_byte = 0;
+  unsigned char codes_byte = 0;
+
+  std::unordered_map<std::string, uint32_t> ids;
+  std::vector<std::string> words;
+
+  TreeHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, TREE_MAGIC, sizeof(header.magic));
+  header.version = TREE_VERSION;
+
+  char buf[MAX_BUF];
+  uint64_t open_nodes = 1;
+  while (open_nodes > 0 && read_node(&tree, buf, sizeof(buf))) {
+    size_t len = strlen(buf);
+    if (len > 0 && buf[len - 1] == '\n') {
+      buf[--len] = '\0';
+    } else {
+      fprintf(stderr, "Fatal: line too long at node %lu\n", header.num_nodes);
+      exit(4);
+    }
+    if (buf[0] == 'X' && len == 1) {
+      put_bits(structure, &structure_byte, header.num_nodes++, 1, 1);
+      ++open_nodes;
+      continue;
+    }
+    int index = leaf_code_index(buf[0]);
+    if (index < 0 || (lettered_code(buf[0]) ?
+          (len < 3 || buf[1] != '(' || buf[len - 1] != ')') : len != 1)) {
+      fprintf(stderr, "Fatal: invalid node %s\n", buf);
+      exit(4);
+    }
+    put_bits(structure, &structure_byte, header.num_nodes++, 1, 0);
+    put_bits(codes, &codes_byte, header.num_leaves++, 4, index);
+    --open_nodes;
+    if (lettered_code(buf[0])) {
+      std::string word(buf + 2, len - 3);
+      auto it = ids.find(word);
+      uint32_t id;
+      if (it == ids.end()) {
+        id = words.size();
+        ids[word] = id;
+        words.push_back(word);
+      } else {
+        id = it->second;
+      }
+      fwrite(&id, sizeof(id), 1, refs);
+      ++header.num_word_refs;
+    }
+  }
+  if (open_nodes > 0) {
+    fprintf(stderr, "Fatal: incomplete tree\n");
+    exit(3);
+  }
+  if (read_node(&tree, buf, sizeof(buf))) {
+    fprintf(stderr, "Fatal: trailing data after complete tree\n");
+    exit(3);
+  }
+  close_tree(&tree);
+  flush_bits(structure, &structure_byte, header.num_nodes, 1);
+  flush_bits(codes, &codes_byte, header.num_leaves, 4);
+
+  header.num_words = words.size();
+  header.word_id_width = 1;
+  while (header.word_id_width < 4 &&
+      (header.num_words >> (8 * header.word_id_width)) != 0) {
+    ++header.word_id_width;
+  }
+  header.structure_offset = align(sizeof(header));
+  header.codes_offset = align(header.structure_offset
+      + (header.num_nodes + 7) / 8);
+  header.word_refs_offset = align(header.codes_offset
+      + (header.num_leaves + 1) / 2);
+  header.dictionary_offset = align(header.word_refs_offset
+      + header.num_word_refs * header.word_id_width);
+
+  FILE* out = fopen(out_name, "wb");
+  if (!out) {
+    fprintf(stderr, "Fatal: failed to open %s\n", out_name);
+    exit(2);
+  }
+  copy_section(out, structure, header.structure_offset);
+  copy_section(out, codes, header.codes_offset);
+
+  // Narrow the spooled 32-bit ids to the final width
+  fseek(out, header.word_refs_offset, SEEK_SET);
+  rewind(refs);
+  uint32_t id;
+  while (fread(&id, sizeof(id), 1, refs) == 1) {
+    fwrite(&id, header.word_id_width, 1, out);
+  }
+  fclose(refs);
+
+  fseek(out, header.dictionary_offset, SEEK_SET);
+  uint64_t offset = 0;
+  for (const std::string& word : words) {
+    fwrite(&offset, sizeof(offset), 1, out);
+    offset += word.size();
+  }
+  fwrite(&offset, sizeof(offset), 1, out);
+  for (const std::string& word : words) {
+    fwrite(word.data(), 1, word.size(), out);
+  }
+
+  header.file_size = ftell(out);
+  fseek(out, 0, SEEK_SET);
+  fwrite(&header, sizeof(header), 1, out);
+  if (fclose(out) != 0) {
+    fprintf(stderr, "Fatal: failed to write %s\n", out_name);
+    exit(2);
+  }
+
+  printf("Packed %lu nodes, %lu leaves and %lu words into %lu bytes\n",
+      header.num_nodes, header.num_leaves, header.num_words, header.file_size);
+  exit(0);
+}
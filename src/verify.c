@@ -1,109 +1,446 @@
 #include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <unistd.h>
+#include "boxfile.h"
+#include "checkpoint.h"
 #include "elimination.h"
+#include "simd.h"
+#include "pool.h"
+#include "shard.h"
+#include "telemetry.h"
+#include "traverse.h"
+#include "tree.h"
 
 double max_area = 5.95;
 double e2_area_min = 5.65; 
 double one_over_e2_min = 0.92593;
 
 
-void verify(char* where, size_t depth, size_t* count_ptr)
+#define PBSTR "++++++++++++++++++++++++++++++++++++++++++++++++++"
+#define PBWIDTH 50
+
+// The leaves to verify, from tree_leaves() when it is known, or 0
+size_t g_num_nodes = 0;
+
+// Progress bar code from: https://stackoverflow.com/a/36315819/1411737
+void print_progress(size_t count)
+{
+    if (!g_num_nodes) {
+        printf("\r%lu leaves", count);
+        fflush(stdout);
+        return;
+    }
+    double fraction = ((double) count) / g_num_nodes;
+    int lpad = (int) (fraction * PBWIDTH);
+    int rpad = PBWIDTH - lpad;
+    printf("\r%6.2f%% [%.*s%*s] of %lu", 100 * fraction, lpad, PBSTR, rpad, "", g_num_nodes);
+    fflush(stdout);
+}
+
+// Checkpoints are written here only by the serial walk
+int g_threads = 1;
+
+void count_leaves(size_t* count_ptr, size_t leaves)
+{
+    size_t count = __atomic_add_fetch(count_ptr, leaves, __ATOMIC_RELAXED);
+    if (count % (1 << 18) < leaves) {
+        print_progress(count);
+    }
+}
+
+// Kernels checking the elimination criterion of a leaf, see walk_tree()
+
+void check_out_of_bounds(LeafContext& ctx, char* where, char* code)
+{
+    verify_out_of_bounds(ctx, where, code[0]);
+}
+
+void check_no_e2_horoball(LeafContext& ctx, char* where, char* code)
+{
+    verify_no_e2_horoball(ctx, where);
+}
+
+// Line has format  K(word) - killer word
+void check_large_horoball(LeafContext& ctx, char* where, char* code)
+{
+    parse_word(code);
+    verify_large_horoball(ctx, where, code);
+}
+
+// Line has format S(word) - g-length 7 word
+void check_g_length(LeafContext& ctx, char* where, char* code)
+{
+    parse_word(code);
+    verify_g_length(ctx, where, code, 7);
+}
+
+// Line has format V(word)
+void check_variety_g_length(LeafContext& ctx, char* where, char* code)
+{
+    parse_word(code);
+    verify_variety_g_length(ctx, where, code, 7);
+}
+
+// Line has format Q(word)
+void check_short_parabolic(LeafContext& ctx, char* where, char* code)
+{
+    parse_word(code);
+    verify_short_parabolic(ctx, where, code);
+}
+
+// Line has format L(word)
+void check_bad_parabolic(LeafContext& ctx, char* where, char* code)
+{
+    parse_word(code);
+    verify_bad_parabolic(ctx, where, code);
+}
+
+// Line has format E(word)
+void check_bad_elliptic(LeafContext& ctx, char* where, char* code)
+{
+    word_pair p = get_word_pair(code);
+    verify_bad_elliptic(ctx, where, p.first, p.second);
+}
+
+// Line has format T(word,word) - variety intersection
+void check_variety_intersection(LeafContext& ctx, char* where, char* code)
+{
+    word_pair p = get_word_pair(code);
+    verify_variety(ctx, where, p.first);
+    verify_variety(ctx, where, p.second);
+    printf("Valid variety intersection: %s and %s\n", p.first, p.second);
+}
+
+// By condition code, in the order of tree_leaf_codes. We fail on the
+// others, guaranteeing completes on the tree.
+const LeafFunc verify_kernels[16] = {
+    check_out_of_bounds, check_out_of_bounds, check_out_of_bounds,
+    check_out_of_bounds, check_out_of_bounds, check_out_of_bounds,
+    check_out_of_bounds, // 0-6
+    check_no_e2_horoball, // 9
+    check_large_horoball, // K
+    check_g_length, // S
+    check_variety_g_length, // V
+    check_short_parabolic, // Q
+    check_bad_parabolic, // L
+    check_bad_elliptic, // E
+    check_variety_intersection, // T
+    0 // I
+};
+
+// Parallel mode
+//
+// The main thread reads the tree and cuts it at split_depth. Each subtree
+// below that depth, and each leaf above it, is copied into memory and
+// verified as a task on the work-stealing pool. The checks of different
+// boxes share no state, and every Box and SL2ACJ lives on the stack of the
+// thread that evaluates it.
+//
+// With -s index/count only the units of one shard are verified, see
+// shard.h, using split_depth as the depth of the units. The other units
+// are skipped unread where the tree allows it.
+//
+// Tasks are kept in depth-first order until they and every task before
+// them are done, so a checkpoint can name the first unfinished one.
+
+typedef struct SubtreeTask {
+    char where[MAX_DEPTH];
+    char* lines;
+    size_t size;
+    size_t* count_ptr;
+    size_t leaves_before;
+    size_t leaves;
+    int fp_flags;
+    bool done;
+    struct SubtreeTask* next;
+} SubtreeTask;
+
+SubtreeTask* g_tasks_head = 0;
+SubtreeTask* g_tasks_tail = 0;
+size_t g_dispatched_leaves = 0;
+int g_retired_flags = 0;
+bool g_sharded = false;
+bool g_recording = false;
+
+void verify_subtree(void* arg)
+{
+    SubtreeTask* task = (SubtreeTask*) arg;
+    TreeReader tree;
+    open_tree_buffer(&tree, task->lines, task->size);
+    walk_tree(&tree, task->where, verify_kernels, print_progress, task->count_ptr,
+            g_threads == 1);
+    close_tree(&tree);
+    free(task->lines);
+    // Flags are sticky, so these may include those of earlier tasks
+    task->fp_flags = fetestexcept(CHECKPOINT_FP_FLAGS);
+    __atomic_store_n(&task->done, true, __ATOMIC_RELEASE);
+}
+
+// Frees the finished tasks at the head of the list
+void retire_tasks()
+{
+    while (g_tasks_head && __atomic_load_n(&g_tasks_head->done, __ATOMIC_ACQUIRE)) {
+        SubtreeTask* task = g_tasks_head;
+        g_retired_flags |= task->fp_flags;
+        g_tasks_head = task->next;
+        free(task);
+    }
+    if (!g_tasks_head) {
+        g_tasks_tail = 0;
+    }
+}
+
+void submit_subtree(Pool* pool, SubtreeTask* task)
+{
+    retire_tasks();
+    if (checkpoint_due()) {
+        SubtreeTask* first = g_tasks_head ? g_tasks_head : task;
+        write_checkpoint(first->where, first->leaves_before,
+                g_retired_flags | fetestexcept(CHECKPOINT_FP_FLAGS));
+    }
+    if (g_tasks_tail) {
+        g_tasks_tail->next = task;
+    } else {
+        g_tasks_head = task;
+    }
+    g_tasks_tail = task;
+    if (pool) {
+        submit_task(pool, verify_subtree, task);
+    } else {
+        verify_subtree(task);
+    }
+}
+
+// The first leaf of the task not before the checkpoint, and the leaves of
+// the task before it. Returns false if the whole task is before it.
+bool find_resume_leaf(const SubtreeTask* task, char* leaf, size_t* before)
+{
+    FILE* fp = fmemopen(task->lines, task->size, "r");
+    if (!fp) {
+        fprintf(stderr, "Fatal: failed to open the subtree at %s\n", task->where);
+        exit(2);
+    }
+    size_t box_depth = strlen(task->where);
+    size_t depth = 0;
+    strcpy(leaf, task->where);
+    *before = 0;
+    bool found = false;
+    char code[MAX_CODE_LEN];
+    while (!found && fgets(code, MAX_CODE_LEN, fp)) {
+        if (code[0] != 'X') {
+            found = !before_checkpoint(leaf);
+            if (found) {
+                break;
+            }
+            ++*before;
+        }
+        check(box_depth + depth + 1 < MAX_DEPTH, leaf);
+        if (advance_boxcode(leaf, box_depth, &depth, code[0])) {
+            break;
+        }
+    }
+    fclose(fp);
+    return found;
+}
+
+void dispatch(Pool* pool, TreeReader* tree, char* where, size_t depth,
+        size_t split_depth, size_t* count_ptr)
 {
     check(depth < MAX_DEPTH, where);
-    *count_ptr += 1;
+    if (g_sharded && depth == split_depth && !in_shard(where)) {
+        skip_node(tree);
+        return;
+    }
     char code[MAX_CODE_LEN];
-    fgets(code, MAX_CODE_LEN, stdin);
-    switch(code[0]) {
-        case 'X': { 
-            *count_ptr -= 1; // don't count branch nodes
-            where[depth] = '0';
-            where[depth + 1] = '\0';
-            verify(where, depth + 1, count_ptr);
-            where[depth] = '1';
-            where[depth + 1] = '\0';
-            verify(where, depth + 1, count_ptr);
-            break; }
-        case '0': 
-        case '1': 
-        case '2': 
-        case '3': 
-        case '4': 
-        case '5': 
-        case '6': {
-            verify_out_of_bounds(where, code[0]);
-            break; }
-        case '9': {
-            verify_no_e2_horoball(where);
-            break; }
-        case 'K': { // Line has format  K(word) - killer word
-            parse_word(code);
-            verify_large_horoball(where, code);
-            break; }
-        case 'S': { // Line has format S(word) - g-length 7 word
-            parse_word(code);
-            verify_g_length(where, code, 7);
-            break; }
-        case 'V': { // Line has format V(word)
-            parse_word(code);
-            verify_variety_g_length(where, code, 7);
-            break; }
-        case 'Q': { // Line has format Q(word)
-            parse_word(code);
-            verify_short_parabolic(where, code);
-            break; }
-        case 'L': { // Line has format L(word)
-            parse_word(code);
-            verify_bad_parabolic(where, code);
-            break; }
-        case 'E': { // Line has format E(word)
-            word_pair p = get_word_pair(code);
-            verify_bad_elliptic(where, p.first, p.second);
-            break; }
-        case 'T': { // Line has format T(word,word) - variety intersection
-            word_pair p = get_word_pair(code);
-            verify_variety(where, p.first);
-            verify_variety(where, p.second);
-            printf("Valid variety intersection: %s and %s\n", p.first, p.second);
-            break; }
-        // We fail by default, guaranteeing completes on the tree
-        default: {
-            check(false, where);
+    if (!read_node(tree, code, MAX_CODE_LEN)) {
+        strcpy(code, "\n"); // fails when the task reads it
+    }
+    if (code[0] == 'X' && depth < split_depth) {
+        check(depth + 1 < MAX_DEPTH, where);
+        where[depth] = '0';
+        where[depth + 1] = '\0';
+        dispatch(pool, tree, where, depth + 1, split_depth, count_ptr);
+        where[depth] = '1';
+        where[depth + 1] = '\0';
+        dispatch(pool, tree, where, depth + 1, split_depth, count_ptr);
+        where[depth] = '\0';
+        return;
+    }
+    if (g_sharded && code[0] != '\n' && !in_shard(where)) {
+        return; // a leaf of another shard
+    }
+    SubtreeTask* task = (SubtreeTask*) calloc(1, sizeof(SubtreeTask));
+    strcpy(task->where, where);
+    task->count_ptr = count_ptr;
+    task->leaves_before = g_dispatched_leaves;
+    FILE* fp = open_memstream(&task->lines, &task->size);
+    fputs(code, fp);
+    // Copy the rest of the subtree, there is one more leaf than branch
+    bool complete = code[0] != '\n';
+    size_t open_nodes = (code[0] == 'X') ? 2 : 0;
+    task->leaves = (code[0] == 'X') ? 0 : 1;
+    while (open_nodes > 0) {
+        if (!read_node(tree, code, MAX_CODE_LEN)) {
+            fputs("\n", fp);
+            complete = false;
+            break;
+        }
+        fputs(code, fp);
+        if (code[0] == 'X') {
+            ++open_nodes;
+        } else {
+            --open_nodes;
+            ++task->leaves;
         }
     }
-    // Block below is only for printing progress. 
-    //    progress bar code from: https://stackoverflow.com/a/36315819/1411737
-    if (*count_ptr % (1 << 18) == 0 && code[0] != 'X') {
-        #define PBSTR "++++++++++++++++++++++++++++++++++++++++++++++++++"
-        #define PBWIDTH 50
-        #define NUM_NODES 1394524064
-        double fraction = ((double) *count_ptr) / NUM_NODES;
-        int lpad = (int) (fraction * PBWIDTH);
-        int rpad = PBWIDTH - lpad;
-        printf("\r%6.2f%% [%.*s%*s] of %d", 100 * fraction, lpad, PBSTR, rpad, "", NUM_NODES);
-        fflush(stdout);
+    fclose(fp);
+    if (g_recording) {
+        record_unit(where, task->lines, task->size);
+    }
+    g_dispatched_leaves += task->leaves;
+    // Skip subtrees that lie wholly before the checkpoint
+    size_t len = strlen(where);
+    if (complete && before_checkpoint(where)
+            && strncmp(where, g_resume.next, len) != 0) {
+        count_leaves(count_ptr, task->leaves);
+        free(task->lines);
+        free(task);
+        return;
     }
-    if (depth == 0) {
-        printf("\r%6.2f%% [%s] of %d\n", 100.00, PBSTR, NUM_NODES);
+    // The walk of a task can't tell the leaves of the tasks running beside
+    // it from its own, so the leaf at the checkpoint is found here
+    char leaf[MAX_DEPTH];
+    size_t before;
+    if (strlen(where) < strlen(g_resume.next) && find_resume_leaf(task, leaf, &before)) {
+        reach_checkpoint(leaf, task->leaves_before + before);
+    } else {
+        reach_checkpoint(where, task->leaves_before);
     }
+    submit_subtree(pool, task);
 }
 
 int main(int argc, char**argv)
 {
-    if(argc != 1) {
-        fprintf(stderr,"Usage: %s < data\n", argv[0]);
+    const char* boxcode = "";
+    const char* checkpoint = 0;
+    bool resume = false;
+    size_t split_depth = 12;
+    const char* shard = "0/1";
+    const char* record = 0;
+    int interval = 0;
+    const char* stats = 0;
+    const char* simd = 0;
+    static struct option long_options[] = {
+        {"checkpoint", required_argument, 0, 'c'},
+        {"resume", no_argument, 0, 'r'},
+        {"stats", required_argument, 0, 'S'},
+        {"simd", required_argument, 0, 'A'},
+        {0, 0, 0, 0}
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "b:j:d:c:rs:o:t:", long_options, 0)) != -1) {
+        if (opt == 'b') {
+            boxcode = optarg;
+        } else if (opt == 'j') {
+            g_threads = atoi(optarg);
+        } else if (opt == 'd') {
+            split_depth = atoi(optarg);
+        } else if (opt == 'c') {
+            checkpoint = optarg;
+        } else if (opt == 'r') {
+            resume = true;
+        } else if (opt == 's') {
+            shard = optarg;
+            g_sharded = true;
+        } else if (opt == 'o') {
+            record = optarg;
+            g_recording = true;
+        } else if (opt == 't') {
+            interval = atoi(optarg);
+        } else if (opt == 'S') {
+            stats = optarg;
+        } else if (opt == 'A') {
+            simd = optarg;
+        } else {
+            optind = argc + 1;
+        }
+    }
+    if(optind < argc - 1 || strlen(boxcode) >= MAX_DEPTH
+            || strspn(boxcode, "01") != strlen(boxcode) || g_threads < 1
+            || interval < 0 || (stats && interval == 0) || (resume && !checkpoint)
+            || !init_simd(simd) || ((g_sharded || g_recording)
+                && (!init_shard(shard, split_depth) || strlen(boxcode) > split_depth))) {
+        fprintf(stderr,"Usage: %s [-b boxcode] [-j threads] [-d split_depth] "
+                "[-c checkpoint_file [--resume]] [-s index/count] [-o record_file] "
+                "[-t seconds [--stats stats_file]] [--simd avx2|sse2|scalar] "
+                "[tree_location] < data\n", argv[0]);
         exit(1);
     }
+    TreeReader tree;
+    open_tree(&tree, optind == argc - 1 ? argv[optind] : NULL);
+    // Decompressing is far faster than checking, one thread per worker
+    tree.prefetch_threads = g_threads;
+    tree.prefetch_bytes = PREFETCH_BYTES;
+    if (!seek_tree(&tree, boxcode)) {
+        fprintf(stderr, "Fatal: no subtree at %s\n", boxcode);
+        exit(2);
+    }
+    // A text stream must start at boxcode, e.g. rootcat -b boxcode
     char where[MAX_DEPTH];
-    size_t depth = 0;
-    where[depth] = '\0';
+    strcpy(where, boxcode);
+    size_t depth = strlen(where);
+    // 0 without a header or tree.idx to count them, as for a text stream
+    size_t total = g_sharded ? 0 : tree_leaves(&tree, boxcode);
+    g_num_nodes = total;
 
     printf("Begin verify %s - {\n", where);
     initialize_roundoff();
+    if (checkpoint) {
+        init_checkpoints(checkpoint, "verify");
+    }
+    if (resume) {
+        resume_checkpoint(boxcode);
+        printf("Resuming at %s after %lu leaves\n", g_resume.next, g_resume.count);
+    }
+    if (interval) {
+        start_telemetry("verify", interval, stats, total, resume ? g_resume.count : 0);
+    }
     size_t count = 0;
-    verify(where, depth, &count);
-    if(!roundoff_ok()){
+    if (g_threads == 1 && !g_sharded && !g_recording) {
+        walk_tree(&tree, where, verify_kernels, print_progress, &count, true);
+    } else {
+        // Shards are cut by dispatch, one thread verifies them in place
+        Pool* pool = g_threads > 1 ? create_pool(g_threads, 16 * g_threads) : 0;
+        g_e2_pool = pool;
+        dispatch(pool, &tree, where, depth, split_depth, &count);
+        if (pool) {
+            destroy_pool(pool);
+            g_e2_pool = 0;
+        }
+        g_tasks_tail = 0;
+        while (g_tasks_head) {
+            SubtreeTask* task = g_tasks_head;
+            g_tasks_head = task->next;
+            free(task);
+        }
+    }
+    close_tree(&tree);
+    stop_telemetry();
+    if (g_num_nodes) {
+        printf("\r%6.2f%% [%s] of %lu\n", 100.00, PBSTR, g_num_nodes);
+    } else {
+        printf("\r%lu leaves\n", count);
+    }
+    bool roundoff = roundoff_ok();
+    if (record) {
+        write_shard_record(record, "verify", boxcode, roundoff);
+    }
+    if(!roundoff){
         printf(". underflow may have occurred\n");
         exit(1);
     }
+    finish_checkpoints();
     printf("Successfully verified all %lu nodes\n", count);
     printf("}.\n");
     exit(0);
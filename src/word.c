@@ -0,0 +1,569 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fenv.h>
+#include <string>
+#include <algorithm>
+#include <vector>
+
+#include "word.h"
+#include "elimination.h"
+#include "hash.h"
+#include "simd.h"
+
+// The blocks of the words interned, by their hash modulo BLOCK_SLOTS. A
+// slot keeps the last block hashed to it until one is shared, so a block
+// may go uncounted, which only costs its words a few multiplies.
+#define BLOCK_SLOTS (1 << 16)
+
+// Blocks of fewer jet multiplies save nothing when shared by two uses
+#define MIN_SHARED_COST 17
+
+typedef struct {
+  uint64_t hash;
+  int uses; // in the words interned, apart in each
+  int first_word; // the index of the first word using it
+} BlockSlot;
+
+typedef struct {
+  std::vector<int> slots; // index + 1 of each program, 0 if empty
+  std::vector<uint64_t> hashes;
+  std::vector<std::string> words;
+  std::vector<WordProgram> programs;
+  std::vector<BlockSlot> blocks;
+} WordTable;
+
+// Programs compiled on this thread
+__thread WordTable* t_words = 0;
+
+#define WORD_FP_FLAGS (FE_UNDERFLOW | FE_OVERFLOW) // see roundoff_ok()
+
+std::vector<WordOp> compile_ops(const char* word)
+{
+  std::vector<WordOp> ops;
+  int M = 0;
+  int N = 0;
+  size_t pos;
+  for (pos = strlen(word); pos > 0; --pos) {
+    char h = word[pos-1];
+    switch(h) {
+      case 'm': --M; break;
+      case 'M': ++M; break;
+      case 'n': --N; break;
+      case 'N': ++N; break;
+      default: {
+                 if (M != 0 || N != 0) {
+                   WordOp op = { WORD_TRANSLATE, M, N };
+                   ops.push_back(op);
+                   M = N = 0;
+                 }
+                 if (h == 'g') {
+                   WordOp op = { WORD_g, 0, 0 };
+                   ops.push_back(op);
+                 } else if (h == 'G') {
+                   WordOp op = { WORD_G, 0, 0 };
+                   ops.push_back(op);
+                 }
+               }
+    }
+  }
+  if (M != 0 || N != 0) {
+    WordOp op = { WORD_TRANSLATE, M, N };
+    ops.push_back(op);
+  }
+  return ops;
+}
+
+// Jet multiplies of an op applied to a matrix
+int op_cost(const WordOp& op)
+{
+  return op.kind == WORD_TRANSLATE ? 2 : 8;
+}
+
+// Matrix multiplies of a k-th power by repeated squaring
+int power_multiplies(int k)
+{
+  int multiplies = -1;
+  for (; k > 1; k >>= 1) {
+    multiplies += 1 + (k & 1);
+  }
+  return multiplies + 1;
+}
+
+bool same_op(const WordOp& a, const WordOp& b)
+{
+  return a.kind == b.kind && a.M == b.M && a.N == b.N;
+}
+
+// The string of ops[start, start + len), read right to left
+std::string block_word(const std::vector<WordOp>& ops, size_t start, size_t len)
+{
+  std::string word;
+  for (size_t i = start + len; i > start; --i) {
+    const WordOp& op = ops[i-1];
+    switch(op.kind) {
+      case WORD_TRANSLATE:
+        word.append(abs(op.M), op.M > 0 ? 'M' : 'm');
+        word.append(abs(op.N), op.N > 0 ? 'N' : 'n');
+        break;
+      case WORD_G: word += 'G'; break;
+      case WORD_g: word += 'g'; break;
+      default: break;
+    }
+  }
+  return word;
+}
+
+BlockSlot& block_slot(WordTable* table, uint64_t hash)
+{
+  return table->blocks[hash & (BLOCK_SLOTS - 1)];
+}
+
+// Whether the block at ops[start, start + len) is used twice or more
+bool shared_block(WordTable* table, const std::vector<WordOp>& ops,
+    size_t start, size_t len)
+{
+  std::string block = block_word(ops, start, len);
+  uint64_t hash = fnv1a(FNV_OFFSET, block.data(), block.size());
+  const BlockSlot& slot = block_slot(table, hash);
+  return slot.hash == hash && slot.uses >= 2;
+}
+
+// Counts the blocks worth sharing in the ops of the word at index, which
+// do not overlap, and adds the earlier words that now share one with it
+void count_blocks(WordTable* table, const std::vector<WordOp>& ops, int index,
+    std::vector<int>& replan)
+{
+  std::vector<std::pair<uint64_t, size_t> > ends; // of the last use here
+  for (size_t i = 0; i < ops.size(); ++i) {
+    int cost = op_cost(ops[i]);
+    for (size_t len = 2; i + len <= ops.size() && len < ops.size(); ++len) {
+      cost += op_cost(ops[i + len - 1]);
+      if (cost < MIN_SHARED_COST) {
+        continue;
+      }
+      std::string block = block_word(ops, i, len);
+      uint64_t hash = fnv1a(FNV_OFFSET, block.data(), block.size());
+      size_t j = 0;
+      while (j < ends.size() && ends[j].first != hash) {
+        ++j;
+      }
+      if (j < ends.size() && ends[j].second > i) {
+        continue;
+      }
+      if (j == ends.size()) {
+        ends.push_back(std::make_pair(hash, i + len));
+      }
+      ends[j].second = i + len;
+      BlockSlot& slot = block_slot(table, hash);
+      if (slot.hash != hash && slot.uses >= 2) {
+        continue;
+      }
+      if (slot.hash != hash || slot.uses == 0) {
+        slot.hash = hash;
+        slot.uses = 0;
+        slot.first_word = index;
+      }
+      if (++slot.uses == 2 && slot.first_word != index) {
+        replan.push_back(slot.first_word);
+      }
+    }
+  }
+}
+
+int intern(const char* word, bool count);
+
+// At each op, the power of a repeated block or the shared block saving the
+// most jet multiplies, if any. Ops never hold two translations in a row, so
+// the string of a block compiles back to the same ops.
+std::vector<WordOp> plan_ops(WordTable* table, const std::vector<WordOp>& ops)
+{
+  std::vector<WordOp> plan;
+  bool blocks = false;
+  size_t i = 0;
+  while (i < ops.size()) {
+    int best_saving = 0;
+    size_t best_len = 0;
+    int best_k = 0;
+    // Evaluated once per leaf, so each use only costs its multiply
+    int cost = op_cost(ops[i]);
+    for (size_t len = 2; i + len <= ops.size() && len < ops.size(); ++len) {
+      cost += op_cost(ops[i + len - 1]);
+      if (cost - 8 > best_saving && shared_block(table, ops, i, len)) {
+        best_saving = cost - 8;
+        best_len = len;
+        best_k = 1;
+      }
+    }
+    for (size_t len = 1; i + 2 * len <= ops.size(); ++len) {
+      int k = 1;
+      while (i + (k + 1) * len <= ops.size()) {
+        size_t j = 0;
+        while (j < len && same_op(ops[i + j], ops[i + k * len + j])) {
+          ++j;
+        }
+        if (j < len) {
+          break;
+        }
+        ++k;
+      }
+      if (k < 2) {
+        continue;
+      }
+      int cost = 0;
+      for (size_t j = 0; j < len; ++j) {
+        cost += op_cost(ops[i + j]);
+      }
+      int saving = (k - 1) * cost - 8 * (power_multiplies(k) + 1);
+      if (saving > best_saving) {
+        best_saving = saving;
+        best_len = len;
+        best_k = k;
+      }
+    }
+    if (best_k > 0) {
+      std::string block = block_word(ops, i, best_len);
+      WordOp op = { WORD_BLOCK, intern(block.c_str(), false), best_k };
+      plan.push_back(op);
+      i += best_k * best_len;
+      blocks = true;
+    } else {
+      plan.push_back(ops[i]);
+      ++i;
+    }
+  }
+  if (!blocks) {
+    plan.clear();
+  }
+  return plan;
+}
+
+WordOp* copy_ops(const std::vector<WordOp>& ops, const char* word)
+{
+  WordOp* copy = (WordOp*) malloc((ops.size() + 1) * sizeof(WordOp));
+  if (copy == NULL) {
+    fprintf(stderr, "Fatal: out of memory compiling %s\n", word);
+    exit(1);
+  }
+  if (!ops.empty()) {
+    memcpy(copy, &ops[0], ops.size() * sizeof(WordOp));
+  }
+  return copy;
+}
+
+// Plans the word at index again with the blocks counted so far
+void replan_word(WordTable* table, int index)
+{
+  const WordProgram& old = table->programs[index];
+  std::vector<WordOp> ops(old.ops, old.ops + old.num_ops);
+  // Planning may intern blocks, and move the programs
+  std::vector<WordOp> plan = plan_ops(table, ops);
+  WordProgram& program = table->programs[index];
+  free(program.plan);
+  program.num_steps = plan.size();
+  program.plan = plan.empty() ? NULL
+    : copy_ops(plan, table->words[index].c_str());
+}
+
+// Open addressing on a power of two table, at most half full
+void grow_table(WordTable* table)
+{
+  size_t capacity = table->slots.empty() ? 256 : 2 * table->slots.size();
+  std::vector<int> slots(capacity, 0);
+  for (size_t i = 0; i < table->hashes.size(); ++i) {
+    size_t slot = table->hashes[i] & (capacity - 1);
+    while (slots[slot] != 0) {
+      slot = (slot + 1) & (capacity - 1);
+    }
+    slots[slot] = int(i) + 1;
+  }
+  table->slots.swap(slots);
+}
+
+// The slot of word, or the empty slot it would take
+size_t find_slot(const WordTable* table, uint64_t hash, const char* word)
+{
+  size_t mask = table->slots.size() - 1;
+  size_t slot = hash & mask;
+  while (table->slots[slot] != 0) {
+    int index = table->slots[slot] - 1;
+    if (table->hashes[index] == hash && table->words[index] == word) {
+      break;
+    }
+    slot = (slot + 1) & mask;
+  }
+  return slot;
+}
+
+// Words from the data count their blocks, see count_blocks(), and blocks
+// interned by plans do not
+int intern(const char* word, bool count)
+{
+  WordTable* table = t_words;
+  if (table == NULL) {
+    table = t_words = new WordTable;
+    grow_table(table);
+    table->blocks.resize(BLOCK_SLOTS);
+  }
+
+  uint64_t hash = fnv1a(FNV_OFFSET, word, strlen(word));
+  size_t slot = find_slot(table, hash, word);
+  if (table->slots[slot] != 0) {
+    return table->slots[slot] - 1;
+  }
+
+  std::vector<WordOp> ops = compile_ops(word);
+  WordProgram program;
+  program.num_ops = ops.size();
+  program.ops = copy_ops(ops, word);
+  program.num_steps = 0;
+  program.plan = NULL;
+  int index = int(table->programs.size());
+  table->hashes.push_back(hash);
+  table->words.push_back(word);
+  table->programs.push_back(program);
+  table->slots[slot] = index + 1;
+  if (2 * table->programs.size() > table->slots.size()) {
+    grow_table(table);
+  }
+
+  std::vector<int> replan;
+  if (count) {
+    count_blocks(table, ops, index, replan);
+  }
+  // Planning interns the blocks of the word
+  replan.push_back(index);
+  for (size_t i = 0; i < replan.size(); ++i) {
+    replan_word(table, replan[i]);
+  }
+  return index;
+}
+
+int intern_word(const char* word)
+{
+  return intern(word, true);
+}
+
+const WordProgram* word_program(int index)
+{
+  return &t_words->programs[index];
+}
+
+SL2ACJ power_of(const SL2ACJ& x, int k)
+{
+  SL2ACJ square(x);
+  SL2ACJ result;
+  bool started = false;
+  for (; k > 0; k >>= 1) {
+    if (k & 1) {
+      result = started ? sl2acj_mul(square, result) : square;
+      started = true;
+    }
+    if (k > 1) {
+      square = sl2acj_mul(square, square);
+    }
+  }
+  return result;
+}
+
+// With held, the flags of the run are set aside from hold_flags() to
+// release_flags(), and the flags raised in between are added to *held.
+// G, g and the translations are shared with the ops of the words, so
+// their flags are always raised.
+void hold_flags(int* held, fexcept_t* run)
+{
+  if (held) {
+    fegetexceptflag(run, WORD_FP_FLAGS);
+    feclearexcept(WORD_FP_FLAGS);
+  }
+}
+
+void release_flags(int* held, const fexcept_t* run)
+{
+  if (held) {
+    *held |= fetestexcept(WORD_FP_FLAGS);
+    fesetexceptflag(run, WORD_FP_FLAGS);
+  }
+}
+
+SL2ACJ run_steps(LeafContext& ctx, const WordOp* steps, size_t num_steps,
+    int* held);
+
+// Once full, the cache replaces its entries in order
+const SL2ACJ& context_power(LeafContext& ctx, int block, int k, int* held)
+{
+  int cached = ctx.num_powers < POWER_CACHE ? ctx.num_powers : POWER_CACHE;
+  int i;
+  for (i = 0; i < cached; ++i) {
+    if (ctx.block[i] == block && ctx.exponent[i] == k) {
+      break;
+    }
+  }
+  if (i == cached) {
+    int flags = 0;
+    SL2ACJ power;
+    if (k > 1) {
+      // Copied, as the block may leave the cache for its power
+      SL2ACJ x = context_power(ctx, block, 1, &flags);
+      fexcept_t run;
+      hold_flags(&flags, &run);
+      power = power_of(x, k);
+      release_flags(&flags, &run);
+    } else {
+      const WordProgram* program = word_program(block);
+      power = program->num_steps > 0
+        ? run_steps(ctx, program->plan, program->num_steps, &flags)
+        : run_steps(ctx, program->ops, program->num_ops, &flags);
+    }
+    i = ctx.num_powers++ % POWER_CACHE;
+    ctx.block[i] = block;
+    ctx.exponent[i] = k;
+    ctx.power[i] = power;
+    ctx.power_flags[i] = flags;
+  }
+  if (held) {
+    *held |= ctx.power_flags[i];
+  } else if (ctx.power_flags[i]) {
+    feraiseexcept(ctx.power_flags[i]);
+  }
+  return ctx.power[i];
+}
+
+SL2ACJ run_steps(LeafContext& ctx, const WordOp* steps, size_t num_steps,
+    int* held)
+{
+  ACJ one(1), zero(0);
+  SL2ACJ w(one, zero, zero, one);
+  fexcept_t run;
+  for (size_t i = 0; i < num_steps; ++i) {
+    const WordOp& op = steps[i];
+    if (op.kind == WORD_TRANSLATE) {
+      const ACJ& T = context_T(ctx, op.M, op.N);
+      hold_flags(held, &run);
+      w = SL2ACJ(acj_add(w.a, acj_mul(T, w.c)), acj_add(w.b, acj_mul(T, w.d)),
+          w.c, w.d);
+      release_flags(held, &run);
+      continue;
+    }
+    const SL2ACJ& x = op.kind == WORD_G ? context_G(ctx)
+      : op.kind == WORD_g ? context_g(ctx) : context_power(ctx, op.M, op.N, held);
+    hold_flags(held, &run);
+    w = sl2acj_mul(x, w);
+    release_flags(held, &run);
+  }
+  return w;
+}
+
+SL2ACJ run_word(LeafContext& ctx, const WordProgram* program)
+{
+  if (program->num_steps > 0) {
+    return run_steps(ctx, program->plan, program->num_steps, NULL);
+  }
+  return run_steps(ctx, program->ops, program->num_ops, NULL);
+}
+
+// Same operations in the same order as the string, see construct_word()
+SL2ACJ run_word_ops(LeafContext& ctx, const WordProgram* program)
+{
+  return run_steps(ctx, program->ops, program->num_ops, NULL);
+}
+
+void cache_word(LeafContext& ctx, int index, const SL2ACJ& w, int flags)
+{
+  int i = ctx.num_words++ % WORD_CACHE;
+  ctx.word[i] = index;
+  ctx.matrix[i] = w;
+  ctx.word_flags[i] = flags;
+}
+
+// Evaluates the plan of the word at index for n contexts in the lanes of
+// the kernels, and caches it in each
+void batch_word(LeafContext* leaves, size_t n, int index)
+{
+  const WordProgram* program = word_program(index);
+  const WordOp* steps = program->num_steps > 0 ? program->plan : program->ops;
+  size_t num_steps = program->num_steps > 0 ? program->num_steps : program->num_ops;
+  fexcept_t run;
+  ACJ one(1), zero(0);
+  SL2ACJ identity(one, zero, zero, one);
+  SL2ACJLanes lanes[2], x;
+  ACJLanes T;
+  for (size_t first = 0; first < n; first += SIMD_LANES) {
+    int flags = 0;
+    int* held = program->num_steps > 0 ? &flags : NULL;
+    // Unused lanes repeat the last box
+    LeafContext* lane_leaf[SIMD_LANES];
+    for (int lane = 0; lane < SIMD_LANES; ++lane) {
+      lane_leaf[lane] = &leaves[std::min(first + lane, n - 1)];
+    }
+    SL2ACJLanes* w = &lanes[0];
+    SL2ACJLanes* r = &lanes[1];
+    for (int lane = 0; lane < SIMD_LANES; ++lane) {
+      set_lane(*w, lane, identity);
+    }
+    for (size_t i = 0; i < num_steps; ++i) {
+      const WordOp& op = steps[i];
+      if (op.kind == WORD_TRANSLATE) {
+        for (int lane = 0; lane < SIMD_LANES; ++lane) {
+          set_lane(T, lane, context_T(*lane_leaf[lane], op.M, op.N));
+        }
+        hold_flags(held, &run);
+        g_simd.translate_lanes(T, *w);
+        release_flags(held, &run);
+        continue;
+      }
+      for (int lane = 0; lane < SIMD_LANES; ++lane) {
+        LeafContext& leaf = *lane_leaf[lane];
+        switch(op.kind) {
+          case WORD_G: set_lane(x, lane, context_G(leaf)); break;
+          case WORD_g: set_lane(x, lane, context_g(leaf)); break;
+          default: set_lane(x, lane, context_power(leaf, op.M, op.N, held)); break;
+        }
+      }
+      hold_flags(held, &run);
+      g_simd.mul_lanes(x, *w, *r);
+      release_flags(held, &run);
+      std::swap(w, r);
+    }
+    size_t used = std::min(n - first, size_t(SIMD_LANES));
+    for (size_t lane = 0; lane < used; ++lane) {
+      // The flags are those of every lane, so the boxes are evaluated again
+      // one at a time to hold their own, with their blocks cached
+      int own = flags;
+      if (flags && used > 1) {
+        own = 0;
+        run_steps(leaves[first + lane], steps, num_steps, &own);
+      }
+      cache_word(leaves[first + lane], index, get_lane(*w, lane), own);
+    }
+  }
+}
+
+const SL2ACJ& context_word(LeafContext& ctx, int index, int* held)
+{
+  int cached = ctx.num_words < WORD_CACHE ? ctx.num_words : WORD_CACHE;
+  int i;
+  for (i = 0; i < cached; ++i) {
+    if (ctx.word[i] == index) {
+      break;
+    }
+  }
+  if (i == cached) {
+    if (ctx.batch) {
+      // The leaves before this one are done with the batch
+      size_t offset = &ctx - ctx.batch;
+      batch_word(&ctx, ctx.batch_size - offset, index);
+    } else {
+      const WordProgram* program = word_program(index);
+      int flags = 0;
+      SL2ACJ w = program->num_steps > 0
+        ? run_steps(ctx, program->plan, program->num_steps, &flags)
+        : run_steps(ctx, program->ops, program->num_ops, NULL);
+      cache_word(ctx, index, w, flags);
+    }
+    i = (ctx.num_words - 1) % WORD_CACHE;
+  }
+  *held |= ctx.word_flags[i];
+  return ctx.matrix[i];
+}
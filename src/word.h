@@ -0,0 +1,67 @@
+#ifndef _word_h_
+#define _word_h_
+#include <stddef.h>
+#include "box.h"
+
+// Compiled words
+//
+// A word is read right to left as in construct_word(). Each run of
+// m, M, n and N becomes one translation by M + N*lattice, and each g or G
+// one multiplication by g or G, so the ops of a program repeat the
+// operations of the string in the same order and give bit-identical
+// matrices. Programs are interned in a table of the calling thread, keyed
+// by an FNV-1a hash of the word, and referred to by their index.
+//
+// A word with repeated blocks of ops also gets a plan. Each block is
+// interned as a word of its own, evaluated once per leaf and multiplied in
+// where it occurs. A block repeated k times in a row, as in gNgNgNgN or a
+// long run of g, is raised to the k-th power by repeated squaring. A block
+// that recurs apart, in the word or in other words interned on the thread,
+// is shared: the words of a leaf reuse its matrix, see context_power().
+// Blocks are only planned where they save jet multiplies. The plan changes
+// the order of multiplication, and so the rounding, so a check that fails
+// on the plan's matrix is retried on the matrix of the ops, see
+// word_holds().
+
+typedef enum { WORD_TRANSLATE, WORD_G, WORD_g, WORD_BLOCK } WordOpKind;
+
+typedef struct {
+  WordOpKind kind;
+  int M; // WORD_BLOCK: the index of the block
+  int N; // WORD_BLOCK: the exponent, 1 for a shared block
+} WordOp;
+
+typedef struct {
+  size_t num_ops;
+  WordOp* ops;
+  size_t num_steps; // 0 without a plan
+  WordOp* plan;
+} WordProgram;
+
+// The index of the program of word, compiling it on first use
+int intern_word(const char* word);
+
+// The program at index, valid until the next word is interned on the
+// calling thread. Interning a word may plan earlier words again, when it
+// shares a block with them.
+const WordProgram* word_program(int index);
+
+struct LeafContext;
+
+// G, g, the translations and the blocks come from the context of the leaf.
+// run_word() follows the plan if there is one, run_word_ops() the ops.
+SL2ACJ run_word(LeafContext& ctx, const WordProgram* program);
+
+SL2ACJ run_word_ops(LeafContext& ctx, const WordProgram* program);
+
+// The matrix of the word at index by run_word(), cached in the context. If
+// the context is in a batch, the word is evaluated for it and the rest of
+// the batch at once, SIMD_LANES boxes at a time, with each lane doing the
+// operations of run_word() for its box. For a word with a plan, the
+// FE_UNDERFLOW and FE_OVERFLOW flags raised by the multiplications of the
+// plan are added to *held instead of being raised, so that they can be
+// dropped with the plan's matrix, see word_holds(). In a batch, they are
+// still those of the box alone.
+const SL2ACJ& context_word(LeafContext& ctx, int index, int* held);
+
+#endif // _word_h_